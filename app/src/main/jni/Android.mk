@@ -3,7 +3,16 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_MODULE    := native-gyro
-LOCAL_SRC_FILES := nativegyro.cpp
+LOCAL_SRC_FILES := nativegyro.cpp sensorfusion.cpp magcalibration.cpp fusionstate.cpp tracecodec.cpp \
+                   framescheduler.cpp fixedfusion.cpp motionfeatures.cpp
+# tracedecoder.cpp is host only, it is built by tools/tracedump
+# armeabi has no FPU and mips cores often have a weak one, use the
+# fixed-point fusion there
+ifneq ($(filter armeabi mips,$(TARGET_ARCH_ABI)),)
+LOCAL_CFLAGS    += -DNATIVEGYRO_FIXED_POINT
+endif
+# record the raw sensor streams to <internalDataPath>/trace-<start ms>.ngt
+#LOCAL_CFLAGS   += -DNATIVEGYRO_TRACE
 LOCAL_LDLIBS    := -llog -landroid -lEGL -lGLESv1_CM
 LOCAL_STATIC_LIBRARIES := android_native_app_glue
 
@@ -0,0 +1,451 @@
+//
+// Fixed-point gyro integration and complementary filter for targets
+// without a usable FPU (armeabi, mips). Enabled with NATIVEGYRO_FIXED_POINT.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "fixedfusion.h"
+
+// 2^-24 rad residual, below the float resolution of the outputs
+#define CORDIC_ITERATIONS 24
+// 1 / prod(sqrt(1 + 2^-2i)) in Q30
+#define CORDIC_GAIN 652032874
+// below this half angle (Q30) sin(x) = x is exact in Q30
+#define SMALL_ANGLE 1024
+
+// atan(2^-i) in Q29
+static const int32_t cordicAtan[CORDIC_ITERATIONS] = {
+        421657428, 248918915, 131521918, 66762579, 33510843, 16771758, 8387925, 4194219,
+        2097141, 1048575, 524288, 262144, 131072, 65536, 32768, 16384,
+        8192, 4096, 2048, 1024, 512, 256, 128, 64
+};
+
+/*Func. Prototypes*/
+
+static void quaternionMultiply(const int32_t a[], const int32_t b[], int32_t res[]);
+static void quaternionNormalize(int32_t q[]);
+static void updateOrientation(struct fixed_fusion* ff);
+static void setOrientation(struct fixed_fusion* ff, const int32_t o[]);
+
+static inline int32_t mulQ30(int32_t a, int32_t b) {
+    return (int32_t) (((int64_t) a * b) >> 30);
+}
+
+// v if sign is 0, -v if sign is -1
+static inline int32_t applySign(int32_t v, int32_t sign) {
+    return (v ^ sign) - sign;
+}
+
+static inline int32_t toAngle(float v) {
+    return (int32_t) (v * (float) FIXED_ANGLE_ONE);
+}
+
+static inline float fromAngle(int32_t v) {
+    return v * (1.0f / FIXED_ANGLE_ONE);
+}
+
+/*
+ *  isqrt64
+ *
+ *  integer square root, floor(sqrt(n))
+ * */
+static uint32_t isqrt64(uint64_t n) {
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > n) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (n >= res + bit) {
+            n -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) res;
+}
+
+/*
+ *  cordicSinCos
+ *
+ *  INPUT:
+ *   angle: Q29 radians, any value in [-2pi, 2pi]
+ *
+ *   OUTPUT:
+ *   s, c: sine and cosine in Q30
+ * */
+static void cordicSinCos(int32_t angle, int32_t* s, int32_t* c) {
+    int64_t a = angle;
+    if (a > FIXED_PI) a -= FIXED_TWO_PI;
+    if (a < -FIXED_PI) a += FIXED_TWO_PI;
+
+    // CORDIC converges for +-pi/2, fold the other half over
+    int negate = 0;
+    if (a > FIXED_HALF_PI) {
+        a -= FIXED_PI;
+        negate = 1;
+    } else if (a < -FIXED_HALF_PI) {
+        a += FIXED_PI;
+        negate = 1;
+    }
+
+    int32_t x = CORDIC_GAIN;
+    int32_t y = 0;
+    int32_t z = (int32_t) a;
+    // the rotation direction is data dependent, keep it branch free
+    for (int i = 0; i < CORDIC_ITERATIONS; i++) {
+        const int32_t sign = z >> 31;
+        const int32_t dx = y >> i;
+        const int32_t dy = x >> i;
+        x -= applySign(dx, sign);
+        y += applySign(dy, sign);
+        z -= applySign(cordicAtan[i], sign);
+    }
+
+    *c = negate ? -x : x;
+    *s = negate ? -y : y;
+}
+
+/*
+ *  cordicAtan2
+ *
+ *  INPUT:
+ *   y, x: same fixed-point format, magnitude up to 2 in Q30
+ *
+ *   OUTPUT:
+ *   angle in Q29 radians, [-pi, pi]
+ * */
+static int32_t cordicAtan2(int32_t y, int32_t x) {
+    // headroom for the CORDIC gain of 1.65
+    x >>= 2;
+    y >>= 2;
+    if (x == 0 && y == 0) {
+        return 0;
+    }
+
+    // rotate into the right half plane by +-90 degrees
+    int32_t z = 0;
+    if (x < 0) {
+        const int32_t t = x;
+        if (y >= 0) {
+            x = y;
+            y = -t;
+            z = FIXED_HALF_PI;
+        } else {
+            x = -y;
+            y = t;
+            z = -FIXED_HALF_PI;
+        }
+    }
+
+    for (int i = 0; i < CORDIC_ITERATIONS; i++) {
+        const int32_t sign = y >> 31;
+        const int32_t dx = y >> i;
+        const int32_t dy = x >> i;
+        x += applySign(dx, sign);
+        y -= applySign(dy, sign);
+        z += applySign(cordicAtan[i], sign);
+    }
+    return z;
+}
+
+/*
+ *  cordicAsin
+ *
+ *  INPUT:
+ *   v: Q30
+ *
+ *   OUTPUT:
+ *   asin(v) in Q29 radians
+ * */
+static int32_t cordicAsin(int32_t v) {
+    if (v > FIXED_ONE) v = FIXED_ONE;
+    if (v < -FIXED_ONE) v = -FIXED_ONE;
+    const uint64_t one = 1ULL << 60;
+    const int32_t c = (int32_t) isqrt64(one - (uint64_t) ((int64_t) v * v));
+    return cordicAtan2(v, c);
+}
+
+void fixedFusion_init(struct fixed_fusion* ff) {
+    memset(ff, 0, sizeof(*ff));
+    ff->q[0] = FIXED_ONE;
+}
+
+/*
+ * fixedFusion_setOrientation
+ *
+ *  sets the orientation like getRotationMatrixFromOrientation does
+ *
+ * INPUT:
+ *  o: azimuth, pitch, roll (rad)
+ * */
+void fixedFusion_setOrientation(struct fixed_fusion* ff, const float o[]) {
+    int32_t fo[3];
+    fo[0] = toAngle(o[0]);
+    fo[1] = toAngle(o[1]);
+    fo[2] = toAngle(o[2]);
+    setOrientation(ff, fo);
+    updateOrientation(ff);
+}
+
+/*
+ * fixedFusion_integrate
+ *
+ *  applies one gyro step, the counterpart of getRotationVectorFromGyro,
+ *  sensorManager_getRotationMatrixFromVector and matrixMultiplication
+ *
+ * INPUT:
+ *  rate: angular speed (rad/s)
+ *  dT: step length (s)
+ * */
+void fixedFusion_integrate(struct fixed_fusion* ff, const float rate[], float dT) {
+    // half rotation vector in Q30
+    const float scale = dT * 0.5f * (float) FIXED_ONE;
+    int32_t h[3];
+    h[0] = (int32_t) (rate[0] * scale);
+    h[1] = (int32_t) (rate[1] * scale);
+    h[2] = (int32_t) (rate[2] * scale);
+
+    const uint64_t n2 = (uint64_t) ((int64_t) h[0] * h[0]) +
+                        (uint64_t) ((int64_t) h[1] * h[1]) +
+                        (uint64_t) ((int64_t) h[2] * h[2]);
+    const int32_t halfTheta = (int32_t) isqrt64(n2);
+
+    int32_t dq[4];
+    if (halfTheta < SMALL_ANGLE) {
+        dq[0] = FIXED_ONE;
+        dq[1] = h[0];
+        dq[2] = h[1];
+        dq[3] = h[2];
+    } else {
+        int32_t s, c;
+        cordicSinCos(halfTheta >> 1, &s, &c);
+        // sin(theta/2) / (theta/2) in Q30
+        const int32_t k = (int32_t) (((int64_t) s << 30) / halfTheta);
+        dq[0] = c;
+        dq[1] = mulQ30(h[0], k);
+        dq[2] = mulQ30(h[1], k);
+        dq[3] = mulQ30(h[2], k);
+    }
+
+    int32_t q[4];
+    quaternionMultiply(ff->q, dq, q);
+    quaternionNormalize(q);
+    memcpy(ff->q, q, sizeof(q));
+}
+
+/*
+ * fixedFusion_getOrientation
+ *
+ *  the counterpart of sensorManager_getOrientation on gyroMatrix
+ *
+ * OUTPUT:
+ *  o: azimuth, pitch, roll (rad)
+ * */
+void fixedFusion_getOrientation(struct fixed_fusion* ff, float o[]) {
+    updateOrientation(ff);
+    o[0] = fromAngle(ff->orientation[0]);
+    o[1] = fromAngle(ff->orientation[1]);
+    o[2] = fromAngle(ff->orientation[2]);
+}
+
+/*
+ * fixedFusion_blend
+ *
+ *  complementary filter of the gyro and acc/mag orientation with the same
+ *  +-180 degree handling as calculateFusedOrientation. The gyro state is
+ *  reset to the result.
+ *
+ * INPUT:
+ *  accMagOrientation: azimuth, pitch, roll from acc/mag (rad)
+ *  filterCoefficient: weight of the gyro orientation
+ *
+ * OUTPUT:
+ *  fused: azimuth, pitch, roll (rad)
+ * */
+void fixedFusion_blend(struct fixed_fusion* ff, const float accMagOrientation[],
+                       float filterCoefficient, float fused[]) {
+    const int64_t k = (int64_t) (filterCoefficient * (float) FIXED_ONE);
+    const int64_t oneMinusK = FIXED_ONE - k;
+
+    int32_t result[3];
+    for (int i = 0; i < 3; i++) {
+        const int64_t g = ff->orientation[i];
+        const int64_t a = toAngle(accMagOrientation[i]);
+        int64_t f;
+
+        if (g < -FIXED_HALF_PI && a > 0) {
+            f = (k * (g + FIXED_TWO_PI) + oneMinusK * a) >> 30;
+            f -= (f > FIXED_PI) ? FIXED_TWO_PI : 0;
+        } else if (a < -FIXED_HALF_PI && g > 0) {
+            f = (k * g + oneMinusK * (a + FIXED_TWO_PI)) >> 30;
+            f -= (f > FIXED_PI) ? FIXED_TWO_PI : 0;
+        } else {
+            f = (k * g + oneMinusK * a) >> 30;
+        }
+        result[i] = (int32_t) f;
+    }
+
+    setOrientation(ff, result);
+    memcpy(ff->orientation, result, sizeof(result));
+
+    fused[0] = fromAngle(result[0]);
+    fused[1] = fromAngle(result[1]);
+    fused[2] = fromAngle(result[2]);
+}
+
+/*
+ * fixedFusion_getMatrix
+ *
+ *  rotation matrix of the state, same layout as gyroMatrix. Not meant for
+ *  the per sample path.
+ * */
+void fixedFusion_getMatrix(const struct fixed_fusion* ff, float R[]) {
+    const float s = 1.0f / FIXED_ONE;
+    float rv[4];
+    rv[0] = ff->q[1] * s;
+    rv[1] = ff->q[2] * s;
+    rv[2] = ff->q[3] * s;
+    rv[3] = ff->q[0] * s;
+
+    const float sq_q1 = 2 * rv[0] * rv[0];
+    const float sq_q2 = 2 * rv[1] * rv[1];
+    const float sq_q3 = 2 * rv[2] * rv[2];
+    const float q1_q2 = 2 * rv[0] * rv[1];
+    const float q3_q0 = 2 * rv[2] * rv[3];
+    const float q1_q3 = 2 * rv[0] * rv[2];
+    const float q2_q0 = 2 * rv[1] * rv[3];
+    const float q2_q3 = 2 * rv[1] * rv[2];
+    const float q1_q0 = 2 * rv[0] * rv[3];
+
+    R[0] = 1 - sq_q2 - sq_q3; R[1] = q1_q2 - q3_q0;     R[2] = q1_q3 + q2_q0;
+    R[3] = q1_q2 + q3_q0;     R[4] = 1 - sq_q1 - sq_q3; R[5] = q2_q3 - q1_q0;
+    R[6] = q1_q3 - q2_q0;     R[7] = q2_q3 + q1_q0;     R[8] = 1 - sq_q1 - sq_q2;
+}
+
+/*
+ * fixedFusion_setMatrix
+ *
+ *  sets the state from a rotation matrix in gyroMatrix layout. Not meant
+ *  for the per sample path.
+ * */
+void fixedFusion_setMatrix(struct fixed_fusion* ff, const float R[]) {
+    float w, x, y, z;
+    const float trace = R[0] + R[4] + R[8];
+
+    // Shepperd: divide by the largest component
+    if (trace > 0.0f) {
+        const float t = sqrtf(1.0f + trace) * 2.0f;
+        w = 0.25f * t;
+        x = (R[7] - R[5]) / t;
+        y = (R[2] - R[6]) / t;
+        z = (R[3] - R[1]) / t;
+    } else if (R[0] > R[4] && R[0] > R[8]) {
+        const float t = sqrtf(1.0f + R[0] - R[4] - R[8]) * 2.0f;
+        w = (R[7] - R[5]) / t;
+        x = 0.25f * t;
+        y = (R[1] + R[3]) / t;
+        z = (R[2] + R[6]) / t;
+    } else if (R[4] > R[8]) {
+        const float t = sqrtf(1.0f + R[4] - R[0] - R[8]) * 2.0f;
+        w = (R[2] - R[6]) / t;
+        x = (R[1] + R[3]) / t;
+        y = 0.25f * t;
+        z = (R[5] + R[7]) / t;
+    } else {
+        const float t = sqrtf(1.0f + R[8] - R[0] - R[4]) * 2.0f;
+        w = (R[3] - R[1]) / t;
+        x = (R[2] + R[6]) / t;
+        y = (R[5] + R[7]) / t;
+        z = 0.25f * t;
+    }
+
+    ff->q[0] = (int32_t) (w * FIXED_ONE);
+    ff->q[1] = (int32_t) (x * FIXED_ONE);
+    ff->q[2] = (int32_t) (y * FIXED_ONE);
+    ff->q[3] = (int32_t) (z * FIXED_ONE);
+    quaternionNormalize(ff->q);
+    updateOrientation(ff);
+}
+
+/*
+ *  quaternionMultiply
+ *
+ *  hamilton product a * b in Q30, R(a * b) = R(a) R(b)
+ * */
+static void quaternionMultiply(const int32_t a[], const int32_t b[], int32_t res[]) {
+    res[0] = (int32_t) (((int64_t) a[0] * b[0] - (int64_t) a[1] * b[1] -
+                         (int64_t) a[2] * b[2] - (int64_t) a[3] * b[3]) >> 30);
+    res[1] = (int32_t) (((int64_t) a[0] * b[1] + (int64_t) a[1] * b[0] +
+                         (int64_t) a[2] * b[3] - (int64_t) a[3] * b[2]) >> 30);
+    res[2] = (int32_t) (((int64_t) a[0] * b[2] - (int64_t) a[1] * b[3] +
+                         (int64_t) a[2] * b[0] + (int64_t) a[3] * b[1]) >> 30);
+    res[3] = (int32_t) (((int64_t) a[0] * b[3] + (int64_t) a[1] * b[2] -
+                         (int64_t) a[2] * b[1] + (int64_t) a[3] * b[0]) >> 30);
+}
+
+/*
+ *  quaternionNormalize
+ *
+ *  one newton step towards unit length, q *= (3 - |q|^2) / 2. The
+ *  quaternion is renormalized every step, so it is always close to 1.
+ * */
+static void quaternionNormalize(int32_t q[]) {
+    const int64_t n2 = (((int64_t) q[0] * q[0]) >> 30) + (((int64_t) q[1] * q[1]) >> 30) +
+                       (((int64_t) q[2] * q[2]) >> 30) + (((int64_t) q[3] * q[3]) >> 30);
+    const int64_t factor = ((3LL << 30) - n2) >> 1;
+    for (int i = 0; i < 4; i++) {
+        q[i] = (int32_t) (((int64_t) q[i] * factor) >> 30);
+    }
+}
+
+/*
+ *  updateOrientation
+ *
+ *  azimuth, pitch, roll of the quaternion, using the matrix entries that
+ *  sensorManager_getOrientation reads
+ * */
+static void updateOrientation(struct fixed_fusion* ff) {
+    const int64_t w = ff->q[0], x = ff->q[1], y = ff->q[2], z = ff->q[3];
+
+    const int32_t R1 = (int32_t) ((x * y - z * w) >> 29);
+    const int32_t R4 = FIXED_ONE - (int32_t) ((x * x + z * z) >> 29);
+    const int32_t R6 = (int32_t) ((x * z - y * w) >> 29);
+    const int32_t R7 = (int32_t) ((y * z + x * w) >> 29);
+    const int32_t R8 = FIXED_ONE - (int32_t) ((x * x + y * y) >> 29);
+
+    ff->orientation[0] = cordicAtan2(R1, R4);
+    ff->orientation[1] = cordicAsin(-R7);
+    ff->orientation[2] = cordicAtan2(-R6, R8);
+}
+
+/*
+ *  setOrientation
+ *
+ *  quaternion of getRotationMatrixFromOrientation: R = Z * X * Y with
+ *  X, Y, Z the pitch, roll and azimuth rotations used there
+ *
+ *  INPUT:
+ *   o: azimuth, pitch, roll in Q29
+ * */
+static void setOrientation(struct fixed_fusion* ff, const int32_t o[]) {
+    int32_t sZ, cZ, sX, cX, sY, cY;
+    cordicSinCos(o[0] / 2, &sZ, &cZ);
+    cordicSinCos(o[1] / 2, &sX, &cX);
+    cordicSinCos(o[2] / 2, &sY, &cY);
+
+    // the x and z matrices rotate by the negative angle
+    const int32_t qz[4] = { cZ, 0, 0, -sZ };
+    const int32_t qx[4] = { cX, -sX, 0, 0 };
+    const int32_t qy[4] = { cY, 0, sY, 0 };
+
+    int32_t t[4];
+    quaternionMultiply(qx, qy, t);
+    quaternionMultiply(qz, t, ff->q);
+    quaternionNormalize(ff->q);
+}
@@ -0,0 +1,167 @@
+//
+// Deadline based frame scheduler for the render loop.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "framescheduler.h"
+
+// bionic only exports the timerfd wrappers from API 19 on, the syscalls
+// themselves are much older
+#ifndef TFD_TIMER_ABSTIME
+#define TFD_TIMER_ABSTIME 1
+#endif
+
+/*Func. Prototypes*/
+
+static void armTimer(struct frame_scheduler* fs);
+
+int64_t frameScheduler_monotonicClock(void* user) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void frameScheduler_init(struct frame_scheduler* fs, int64_t period,
+                         frame_clock_fn clock, void* clockUser) {
+    memset(fs, 0, sizeof(*fs));
+    fs->period = period;
+    fs->clock = clock;
+    fs->clockUser = clockUser;
+    fs->timerFd = -1;
+}
+
+/*
+ * frameScheduler_openTimer
+ *
+ *  creates the timerfd that fires at the frame deadline. Only valid with
+ *  frameScheduler_monotonicClock. Add timerFd to the looper afterwards.
+ *
+ * OUTPUT:
+ *  false if no timerfd is available, the poll timeout is used then
+ * */
+bool frameScheduler_openTimer(struct frame_scheduler* fs) {
+#if defined(__NR_timerfd_create) && defined(__NR_timerfd_settime)
+    fs->timerFd = (int) syscall(__NR_timerfd_create, CLOCK_MONOTONIC, O_NONBLOCK | O_CLOEXEC);
+    if (fs->timerFd >= 0) {
+        armTimer(fs);
+        return true;
+    }
+#endif
+    fs->timerFd = -1;
+    return false;
+}
+
+void frameScheduler_closeTimer(struct frame_scheduler* fs) {
+    if (fs->timerFd >= 0) {
+        close(fs->timerFd);
+        fs->timerFd = -1;
+    }
+}
+
+/*
+ * frameScheduler_ackTimer
+ *
+ *  drains the timerfd after the looper reported it readable
+ * */
+void frameScheduler_ackTimer(struct frame_scheduler* fs) {
+    uint64_t expirations;
+    if (fs->timerFd >= 0) {
+        while (read(fs->timerFd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+/*
+ * frameScheduler_start
+ *
+ *  starts scheduling frames, the first one is due immediately
+ * */
+void frameScheduler_start(struct frame_scheduler* fs) {
+    if (fs->running) {
+        return;
+    }
+    fs->running = 1;
+    fs->nextFrame = fs->clock(fs->clockUser);
+    armTimer(fs);
+}
+
+void frameScheduler_stop(struct frame_scheduler* fs) {
+    fs->running = 0;
+    armTimer(fs);
+}
+
+bool frameScheduler_due(const struct frame_scheduler* fs) {
+    return fs->running && fs->clock(fs->clockUser) >= fs->nextFrame;
+}
+
+/*
+ * frameScheduler_pollTimeout
+ *
+ *  timeout for ALooper_pollAll
+ *
+ * OUTPUT:
+ *  -1 to block until an event (not running, or the timerfd wakes us),
+ *  0 if a frame is due, otherwise the ms until the deadline rounded up
+ * */
+int frameScheduler_pollTimeout(const struct frame_scheduler* fs) {
+    if (!fs->running) {
+        return -1;
+    }
+    const int64_t remaining = fs->nextFrame - fs->clock(fs->clockUser);
+    if (remaining <= 0) {
+        return 0;
+    }
+    if (fs->timerFd >= 0) {
+        return -1;
+    }
+    return (int) ((remaining + 999999) / 1000000);
+}
+
+/*
+ * frameScheduler_frameDone
+ *
+ *  schedules the next frame one period after the last one was presented.
+ *  Call it right after eglSwapBuffers returned, the scheduler's clock at
+ *  that point is taken as the present time. A frame presented more than a
+ *  period after its deadline counts the periods in between as missed, they
+ *  are skipped instead of rendered in a burst.
+ * */
+void frameScheduler_frameDone(struct frame_scheduler* fs) {
+    fs->frames++;
+
+    const int64_t presentTime = fs->clock(fs->clockUser);
+    const int64_t late = presentTime - fs->nextFrame;
+    if (late > fs->period) {
+        fs->missedFrames += (uint32_t) (late / fs->period);
+    }
+    fs->nextFrame = presentTime + fs->period - FRAME_SLACK_NS;
+    armTimer(fs);
+}
+
+/*
+ * armTimer
+ *
+ *  sets the timerfd to the current deadline, or disarms it when stopped
+ * */
+static void armTimer(struct frame_scheduler* fs) {
+#if defined(__NR_timerfd_settime)
+    if (fs->timerFd < 0) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (fs->running) {
+        // a zero it_value disarms, keep due deadlines at least 1 ns
+        const int64_t deadline = fs->nextFrame > 0 ? fs->nextFrame : 1;
+        its.it_value.tv_sec = deadline / 1000000000LL;
+        its.it_value.tv_nsec = deadline % 1000000000LL;
+    }
+    syscall(__NR_timerfd_settime, fs->timerFd, TFD_TIMER_ABSTIME, &its, NULL);
+#endif
+}
@@ -0,0 +1,55 @@
+//
+// Deadline based frame scheduler for the render loop.
+//
+
+#ifndef NATIVEGYRO_FRAMESCHEDULER_H
+#define NATIVEGYRO_FRAMESCHEDULER_H
+
+#include <stdint.h>
+
+// 60 Hz, there is no NDK API for the display refresh rate before API 24
+#define FRAME_PERIOD_NS 16666667LL
+// wake up this much before the next vsync to have the frame ready
+#define FRAME_SLACK_NS 1000000LL
+
+typedef int64_t (*frame_clock_fn)(void* user);
+
+/**
+ * Tracks the deadline of the next frame so the loop can sleep until
+ * either that deadline or the next event, instead of polling.
+ *
+ * eglSwapBuffers returns at about the vsync, so every frame schedules the
+ * next one a period after its swap returned. This locks the deadline to
+ * the display without a vsync callback.
+ *
+ * The clock is a function pointer, the host can drive the scheduler with
+ * a fake clock. timerFd is a CLOCK_MONOTONIC timerfd armed at the
+ * deadline, or -1 when the poll timeout is used instead.
+ */
+struct frame_scheduler {
+    int64_t period;
+    int64_t nextFrame;
+    frame_clock_fn clock;
+    void* clockUser;
+    int running;
+    int timerFd;
+
+    uint32_t frames;
+    uint32_t missedFrames;
+};
+
+int64_t frameScheduler_monotonicClock(void* user);
+
+void frameScheduler_init(struct frame_scheduler* fs, int64_t period,
+                         frame_clock_fn clock, void* clockUser);
+bool frameScheduler_openTimer(struct frame_scheduler* fs);
+void frameScheduler_closeTimer(struct frame_scheduler* fs);
+void frameScheduler_ackTimer(struct frame_scheduler* fs);
+
+void frameScheduler_start(struct frame_scheduler* fs);
+void frameScheduler_stop(struct frame_scheduler* fs);
+bool frameScheduler_due(const struct frame_scheduler* fs);
+int frameScheduler_pollTimeout(const struct frame_scheduler* fs);
+void frameScheduler_frameDone(struct frame_scheduler* fs);
+
+#endif //NATIVEGYRO_FRAMESCHEDULER_H
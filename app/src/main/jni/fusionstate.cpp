@@ -0,0 +1,129 @@
+//
+// Serialized sensor fusion state used to warm start after a restart.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "fusionstate.h"
+
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME 7
+#endif
+
+/*
+ * checksum
+ *
+ *  FNV-1a over everything in front of the checksum field
+ * */
+static uint32_t checksum(const struct fusion_state* fs) {
+    const uint8_t* p = (const uint8_t*) fs;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(struct fusion_state, checksum); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool allFinite(const float v[], int n) {
+    for (int i = 0; i < n; i++) {
+        if (!isfinite(v[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int64_t fusionState_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * fusionState_seal
+ *
+ *  fills in the header and checksum, call after the payload is written
+ *
+ * INPUT:
+ *  fs: state with payload
+ *  now: fusionState_now() at save time
+ * */
+void fusionState_seal(struct fusion_state* fs, int64_t now) {
+    fs->magic = FUSION_STATE_MAGIC;
+    fs->version = FUSION_STATE_VERSION;
+    fs->size = sizeof(struct fusion_state);
+    fs->savedAt = now;
+    fs->checksum = checksum(fs);
+}
+
+/*
+ * fusionState_validate
+ *
+ *  checks a blob before it is used for a warm start
+ *
+ * INPUT:
+ *  blob: serialized state
+ *  size: size of blob
+ *  now: fusionState_now()
+ *
+ * OUTPUT:
+ *  out: the state, valid only if true is returned
+ * */
+bool fusionState_validate(const void* blob, size_t size, int64_t now, struct fusion_state* out) {
+    if (blob == NULL || size != sizeof(struct fusion_state)) {
+        return false;
+    }
+    memcpy(out, blob, sizeof(*out));
+
+    if (out->magic != FUSION_STATE_MAGIC || out->version != FUSION_STATE_VERSION ||
+        out->size != sizeof(struct fusion_state) || out->checksum != checksum(out)) {
+        return false;
+    }
+
+    const int64_t age = now - out->savedAt;
+    if (age < 0 || age > FUSION_STATE_MAX_AGE_NS) {
+        return false;
+    }
+
+    if (!allFinite(out->gyroMatrix, 9) || !allFinite(out->accMagOrientation, 3) ||
+        !allFinite(out->fusedOrientation, 3)) {
+        return false;
+    }
+
+    // gyroMatrix has to be a rotation
+    const float* R = out->gyroMatrix;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            const float dot = R[i*3] * R[j*3] + R[i*3 + 1] * R[j*3 + 1] + R[i*3 + 2] * R[j*3 + 2];
+            if (fabsf(dot - (i == j ? 1.0f : 0.0f)) > FUSION_STATE_ORTHO_TOLERANCE) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool fusionState_load(const char* path, int64_t now, struct fusion_state* out) {
+    struct fusion_state blob;
+
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    size_t n = fread(&blob, sizeof(blob), 1, fp);
+    fclose(fp);
+
+    return n == 1 && fusionState_validate(&blob, sizeof(blob), now, out);
+}
+
+bool fusionState_save(const char* path, const struct fusion_state* fs) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    size_t n = fwrite(fs, sizeof(*fs), 1, fp);
+    return fclose(fp) == 0 && n == 1;
+}
@@ -0,0 +1,44 @@
+//
+// Serialized sensor fusion state used to warm start after a restart.
+//
+
+#ifndef NATIVEGYRO_FUSIONSTATE_H
+#define NATIVEGYRO_FUSIONSTATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FUSION_STATE_MAGIC 0x53464e47 // "NGFS"
+#define FUSION_STATE_VERSION 2
+// older states are not trusted, the device may have been moved meanwhile
+#define FUSION_STATE_MAX_AGE_NS (5LL * 1000000000LL)
+// allowed deviation of gyroMatrix * gyroMatrix' from identity
+#define FUSION_STATE_ORTHO_TOLERANCE 0.001f
+
+#define FUSION_STATE_ACCMAG_VALID 0x1
+
+/**
+ * Compact, versioned snapshot of the fusion state.
+ *
+ * savedAt is CLOCK_BOOTTIME so the age check also counts time spent in
+ * suspend and rejects states from a previous boot.
+ */
+struct fusion_state {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    int64_t savedAt;
+    float gyroMatrix[9];
+    float accMagOrientation[3];
+    float fusedOrientation[3];
+    uint32_t flags;
+    uint32_t checksum;
+};
+
+int64_t fusionState_now();
+void fusionState_seal(struct fusion_state* fs, int64_t now);
+bool fusionState_validate(const void* blob, size_t size, int64_t now, struct fusion_state* out);
+bool fusionState_load(const char* path, int64_t now, struct fusion_state* out);
+bool fusionState_save(const char* path, const struct fusion_state* fs);
+
+#endif //NATIVEGYRO_FUSIONSTATE_H
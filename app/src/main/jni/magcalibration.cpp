@@ -0,0 +1,410 @@
+//
+// Online hard/soft-iron calibration for the magnetometer.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "magcalibration.h"
+
+#define MAG_CAL_FILE_MAGIC 0x434d474e // "NGMC"
+#define MAG_CAL_FILE_VERSION 1
+
+/*Func. Prototypes*/
+
+static bool solveLinearSystem(double M[], double b[], int n);
+static void jacobiEigen3(double A[], double V[], double eig[]);
+static bool validState(const struct mag_calibration* cal);
+
+/**
+ * On-disk layout of the calibration. Only used by load/save.
+ */
+struct mag_calibration_file {
+    uint32_t magic;
+    uint32_t version;
+    struct mag_calibration cal;
+};
+
+void magCalibration_init(struct mag_calibration* cal) {
+    memset(cal, 0, sizeof(*cal));
+
+    cal->softIron[0] = 1.0f;
+    cal->softIron[4] = 1.0f;
+    cal->softIron[8] = 1.0f;
+}
+
+/*
+ * magCalibration_addSample
+ *
+ *  adds one raw magnetometer sample to the fit statistics and refits
+ *  the model every MAG_CAL_REFIT_INTERVAL accepted samples.
+ *
+ * INPUT:
+ *  cal: calibration state
+ *  raw: uncalibrated magnetic field vector (uT)
+ * */
+void magCalibration_addSample(struct mag_calibration* cal, const float raw[]) {
+    const float dx = raw[0] - cal->last[0];
+    const float dy = raw[1] - cal->last[1];
+    const float dz = raw[2] - cal->last[2];
+    if (cal->weight > 0.0 &&
+        dx*dx + dy*dy + dz*dz < MAG_CAL_MIN_SPACING * MAG_CAL_MIN_SPACING) {
+        return;
+    }
+    memcpy(cal->last, raw, sizeof(cal->last));
+
+    const double x = raw[0];
+    const double y = raw[1];
+    const double z = raw[2];
+    const double d[MAG_CAL_PARAMS] = {
+            x*x, y*y, z*z,
+            2.0*x*y, 2.0*x*z, 2.0*y*z,
+            2.0*x, 2.0*y, 2.0*z
+    };
+
+    int k = 0;
+    for (int i = 0; i < MAG_CAL_PARAMS; i++) {
+        for (int j = i; j < MAG_CAL_PARAMS; j++) {
+            cal->normal[k++] += d[i] * d[j];
+        }
+        cal->rhs[i] += d[i];
+    }
+    cal->weight += 1.0;
+
+    if (cal->weight >= MAG_CAL_MAX_WEIGHT) {
+        for (k = 0; k < MAG_CAL_NORMAL_SIZE; k++) {
+            cal->normal[k] *= 0.5;
+        }
+        for (k = 0; k < MAG_CAL_PARAMS; k++) {
+            cal->rhs[k] *= 0.5;
+        }
+        cal->weight *= 0.5;
+    }
+
+    if (++cal->sinceRefit >= MAG_CAL_REFIT_INTERVAL && cal->weight >= MAG_CAL_MIN_SAMPLES) {
+        cal->sinceRefit = 0;
+        magCalibration_refit(cal);
+    }
+}
+
+/*
+ * magCalibration_refit
+ *
+ *  solves the normal equations for the ellipsoid and derives the offset and
+ *  soft-iron matrix from it. The current correction is kept if the new fit
+ *  is degenerate or not physically plausible.
+ *
+ * INPUT:
+ *  cal: calibration state with accumulated statistics
+ *
+ * OUTPUT:
+ *  true if the correction was updated
+ * */
+bool magCalibration_refit(struct mag_calibration* cal) {
+    double M[MAG_CAL_PARAMS * MAG_CAL_PARAMS];
+    double p[MAG_CAL_PARAMS];
+
+    int k = 0;
+    for (int i = 0; i < MAG_CAL_PARAMS; i++) {
+        for (int j = i; j < MAG_CAL_PARAMS; j++) {
+            M[i * MAG_CAL_PARAMS + j] = cal->normal[k];
+            M[j * MAG_CAL_PARAMS + i] = cal->normal[k];
+            k++;
+        }
+        p[i] = cal->rhs[i];
+    }
+
+    if (!solveLinearSystem(M, p, MAG_CAL_PARAMS)) {
+        return false;
+    }
+
+    // quadric matrix and linear term
+    double A[9] = {
+            p[0], p[3], p[4],
+            p[3], p[1], p[5],
+            p[4], p[5], p[2]
+    };
+    double center[3] = { -p[6], -p[7], -p[8] };
+
+    // center = -inv(A) * v
+    double Ac[9];
+    memcpy(Ac, A, sizeof(Ac));
+    if (!solveLinearSystem(Ac, center, 3)) {
+        return false;
+    }
+
+    // (m - c)' A (m - c) = 1 + c' A c, the sign of both sides flips
+    // together when the origin lies outside the ellipsoid
+    double scale = 1.0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            scale += center[i] * A[i * 3 + j] * center[j];
+        }
+    }
+    if (!(fabs(scale) > 1e-12)) {
+        return false;
+    }
+    for (int i = 0; i < 9; i++) {
+        A[i] /= scale;
+    }
+
+    double V[9];
+    double eig[3];
+    jacobiEigen3(A, V, eig);
+    if (!(eig[0] > 0.0 && eig[1] > 0.0 && eig[2] > 0.0)) {
+        return false;
+    }
+
+    // axis radii of the ellipsoid are 1/sqrt(eigenvalue)
+    double minEig = eig[0], maxEig = eig[0];
+    for (int i = 1; i < 3; i++) {
+        if (eig[i] < minEig) minEig = eig[i];
+        if (eig[i] > maxEig) maxEig = eig[i];
+    }
+    if (sqrt(maxEig / minEig) > MAG_CAL_MAX_ANISOTROPY) {
+        return false;
+    }
+    const double field = pow(eig[0] * eig[1] * eig[2], -1.0 / 6.0);
+    if (field < MAG_CAL_MIN_FIELD || field > MAG_CAL_MAX_FIELD) {
+        return false;
+    }
+
+    // softIron = field * V * sqrt(diag(eig)) * V', maps the ellipsoid onto
+    // a sphere of radius field
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double s = 0.0;
+            for (int e = 0; e < 3; e++) {
+                s += V[i * 3 + e] * sqrt(eig[e]) * V[j * 3 + e];
+            }
+            cal->softIron[i * 3 + j] = (float) (field * s);
+        }
+        cal->offset[i] = (float) center[i];
+    }
+    cal->fieldStrength = (float) field;
+    cal->valid = 1;
+
+    return true;
+}
+
+/*
+ * magCalibration_apply
+ *
+ *  applies the affine correction. With no valid fit this is the identity.
+ *
+ * INPUT:
+ *  cal: calibration state
+ *  raw: uncalibrated magnetic field vector
+ *
+ * OUTPUT:
+ *  corrected: calibrated magnetic field vector (may alias raw)
+ * */
+void magCalibration_apply(const struct mag_calibration* cal, const float raw[], float corrected[]) {
+    const float x = raw[0] - cal->offset[0];
+    const float y = raw[1] - cal->offset[1];
+    const float z = raw[2] - cal->offset[2];
+    const float* W = cal->softIron;
+
+    corrected[0] = W[0] * x + W[1] * y + W[2] * z;
+    corrected[1] = W[3] * x + W[4] * y + W[5] * z;
+    corrected[2] = W[6] * x + W[7] * y + W[8] * z;
+}
+
+bool magCalibration_load(struct mag_calibration* cal, const char* path) {
+    struct mag_calibration_file file;
+
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    size_t n = fread(&file, sizeof(file), 1, fp);
+    fclose(fp);
+
+    if (n != 1 || file.magic != MAG_CAL_FILE_MAGIC || file.version != MAG_CAL_FILE_VERSION) {
+        return false;
+    }
+    // the correction is applied to every sample and only replaced by a
+    // successful refit, so a bad file must not get in
+    if (!validState(&file.cal)) {
+        magCalibration_init(cal);
+        return false;
+    }
+    *cal = file.cal;
+    return true;
+}
+
+bool magCalibration_save(const struct mag_calibration* cal, const char* path) {
+    struct mag_calibration_file file;
+    file.magic = MAG_CAL_FILE_MAGIC;
+    file.version = MAG_CAL_FILE_VERSION;
+    file.cal = *cal;
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    size_t n = fwrite(&file, sizeof(file), 1, fp);
+    return fclose(fp) == 0 && n == 1;
+}
+
+/*
+ *  solveLinearSystem
+ *
+ *  gaussian elimination with partial pivoting for small dense systems
+ *
+ *  INPUT:
+ *   M: n x n matrix (row major), destroyed
+ *   b: right hand side
+ *
+ *   OUTPUT:
+ *   b: solution, valid only if true is returned
+ * */
+static bool solveLinearSystem(double M[], double b[], int n) {
+    double maxDiag = 0.0;
+    for (int i = 0; i < n; i++) {
+        if (fabs(M[i * n + i]) > maxDiag) maxDiag = fabs(M[i * n + i]);
+    }
+    const double tolerance = maxDiag * 1e-12;
+
+    for (int col = 0; col < n; col++) {
+        int pivot = col;
+        for (int r = col + 1; r < n; r++) {
+            if (fabs(M[r * n + col]) > fabs(M[pivot * n + col])) {
+                pivot = r;
+            }
+        }
+        if (!(fabs(M[pivot * n + col]) > tolerance)) {
+            // singular: the samples do not span enough directions yet
+            return false;
+        }
+        if (pivot != col) {
+            for (int c = 0; c < n; c++) {
+                double t = M[col * n + c];
+                M[col * n + c] = M[pivot * n + c];
+                M[pivot * n + c] = t;
+            }
+            double t = b[col];
+            b[col] = b[pivot];
+            b[pivot] = t;
+        }
+        for (int r = col + 1; r < n; r++) {
+            const double f = M[r * n + col] / M[col * n + col];
+            for (int c = col; c < n; c++) {
+                M[r * n + c] -= f * M[col * n + c];
+            }
+            b[r] -= f * b[col];
+        }
+    }
+
+    for (int r = n - 1; r >= 0; r--) {
+        double s = b[r];
+        for (int c = r + 1; c < n; c++) {
+            s -= M[r * n + c] * b[c];
+        }
+        b[r] = s / M[r * n + r];
+    }
+    return true;
+}
+
+/*
+ *  jacobiEigen3
+ *
+ *  eigen decomposition of a symmetric 3x3 matrix with cyclic jacobi rotations
+ *
+ *  INPUT:
+ *   A: symmetric 3x3 matrix, destroyed
+ *
+ *   OUTPUT:
+ *   V: eigenvectors as columns
+ *   eig: eigenvalues
+ * */
+static void jacobiEigen3(double A[], double V[], double eig[]) {
+    memset(V, 0, 9 * sizeof(double));
+    V[0] = V[4] = V[8] = 1.0;
+
+    for (int sweep = 0; sweep < 16; sweep++) {
+        const double off = A[1] * A[1] + A[2] * A[2] + A[5] * A[5];
+        if (off < 1e-30) {
+            break;
+        }
+        for (int p = 0; p < 2; p++) {
+            for (int q = p + 1; q < 3; q++) {
+                const double apq = A[p * 3 + q];
+                if (fabs(apq) < 1e-300) {
+                    continue;
+                }
+                const double theta = (A[q * 3 + q] - A[p * 3 + p]) / (2.0 * apq);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                                 (fabs(theta) + sqrt(theta * theta + 1.0));
+                const double c = 1.0 / sqrt(t * t + 1.0);
+                const double s = t * c;
+
+                for (int k = 0; k < 3; k++) {
+                    const double akp = A[k * 3 + p];
+                    const double akq = A[k * 3 + q];
+                    A[k * 3 + p] = c * akp - s * akq;
+                    A[k * 3 + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++) {
+                    const double apk = A[p * 3 + k];
+                    const double aqk = A[q * 3 + k];
+                    A[p * 3 + k] = c * apk - s * aqk;
+                    A[q * 3 + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++) {
+                    const double vkp = V[k * 3 + p];
+                    const double vkq = V[k * 3 + q];
+                    V[k * 3 + p] = c * vkp - s * vkq;
+                    V[k * 3 + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    eig[0] = A[0];
+    eig[1] = A[4];
+    eig[2] = A[8];
+}
+
+static bool allFinite(const float v[], int n) {
+    for (int i = 0; i < n; i++) {
+        if (!isfinite(v[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ *  validState
+ *
+ *  sanity check of a loaded calibration: everything finite, a plausible
+ *  field strength for a valid fit and the identity correction otherwise
+ * */
+static bool validState(const struct mag_calibration* cal) {
+    if (!allFinite(cal->offset, 3) || !allFinite(cal->softIron, 9) ||
+        !allFinite(cal->last, 3) || !isfinite(cal->fieldStrength)) {
+        return false;
+    }
+    for (int i = 0; i < MAG_CAL_NORMAL_SIZE; i++) {
+        if (!isfinite(cal->normal[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < MAG_CAL_PARAMS; i++) {
+        if (!isfinite(cal->rhs[i])) {
+            return false;
+        }
+    }
+    if (!isfinite(cal->weight) || cal->weight < 0.0 || cal->sinceRefit < 0) {
+        return false;
+    }
+
+    if (cal->valid) {
+        return cal->fieldStrength >= MAG_CAL_MIN_FIELD && cal->fieldStrength <= MAG_CAL_MAX_FIELD;
+    }
+    static const float identity[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    return cal->offset[0] == 0.0f && cal->offset[1] == 0.0f && cal->offset[2] == 0.0f &&
+           memcmp(cal->softIron, identity, sizeof(identity)) == 0;
+}
@@ -0,0 +1,63 @@
+//
+// Online hard/soft-iron calibration for the magnetometer.
+//
+
+#ifndef NATIVEGYRO_MAGCALIBRATION_H
+#define NATIVEGYRO_MAGCALIBRATION_H
+
+#include <stdint.h>
+
+// number of parameters of the general ellipsoid model
+#define MAG_CAL_PARAMS 9
+// unique entries of the symmetric 9x9 normal matrix
+#define MAG_CAL_NORMAL_SIZE 45
+
+// samples needed before the first fit is attempted
+#define MAG_CAL_MIN_SAMPLES 100
+// accepted samples between two refits
+#define MAG_CAL_REFIT_INTERVAL 200
+// samples closer than this (uT) to the last accepted one are skipped,
+// otherwise a device lying on the desk floods the fit with one point
+#define MAG_CAL_MIN_SPACING 1.5f
+// when the accumulated weight reaches this, the statistics are halved
+// so the fit can follow changes in the device magnetics
+#define MAG_CAL_MAX_WEIGHT 20000.0
+// plausible range of the earth's field strength (uT)
+#define MAG_CAL_MIN_FIELD 15.0f
+#define MAG_CAL_MAX_FIELD 100.0f
+// largest allowed ratio between the longest and shortest ellipsoid axis
+#define MAG_CAL_MAX_ANISOTROPY 3.0f
+
+/**
+ * Calibration state.
+ *
+ * Correction is applied as corrected = softIron * (raw - offset).
+ * The sums are the sufficient statistics of the least squares fit of
+ *   a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+ * so every sample is O(1) to add and a refit never revisits old samples.
+ */
+struct mag_calibration {
+    // hard-iron offset
+    float offset[3];
+    // soft-iron correction matrix (row major 3x3)
+    float softIron[9];
+    // radius of the fitted sphere after correction
+    float fieldStrength;
+    int32_t valid;
+
+    // upper triangle of D'D and D'1 of the design matrix
+    double normal[MAG_CAL_NORMAL_SIZE];
+    double rhs[MAG_CAL_PARAMS];
+    double weight;
+    int32_t sinceRefit;
+    float last[3];
+};
+
+void magCalibration_init(struct mag_calibration* cal);
+void magCalibration_addSample(struct mag_calibration* cal, const float raw[]);
+bool magCalibration_refit(struct mag_calibration* cal);
+void magCalibration_apply(const struct mag_calibration* cal, const float raw[], float corrected[]);
+bool magCalibration_load(struct mag_calibration* cal, const char* path);
+bool magCalibration_save(const struct mag_calibration* cal, const char* path);
+
+#endif //NATIVEGYRO_MAGCALIBRATION_H
@@ -0,0 +1,211 @@
+//
+// Sliding window motion features on the fused sensor stream.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "motionfeatures.h"
+
+/*Func. Prototypes*/
+
+static void recomputeSums(struct motion_features* mf);
+static void emitFrame(struct motion_features* mf);
+
+/*
+ * motionFeatures_init
+ *
+ * INPUT:
+ *  hop: samples between two frames, clamped to [1, MOTION_WINDOW]
+ *  frame: called with every frame, may be NULL
+ * */
+void motionFeatures_init(struct motion_features* mf, int hop,
+                         motion_frame_fn frame, void* frameUser) {
+    memset(mf, 0, sizeof(*mf));
+    if (hop < 1) hop = 1;
+    if (hop > MOTION_WINDOW) hop = MOTION_WINDOW;
+    mf->hop = hop;
+    mf->pendingJerk = -1.0f;
+    mf->frame = frame;
+    mf->frameUser = frameUser;
+}
+
+/*
+ * motionFeatures_addAccel
+ *
+ *  takes an accelerometer sample, the window itself only advances with
+ *  motionFeatures_addSample
+ * */
+void motionFeatures_addAccel(struct motion_features* mf, int64_t timestamp, const float accel[]) {
+    if (mf->accelTimestamp != 0) {
+        const int64_t dTns = timestamp - mf->accelTimestamp;
+        if (dTns <= 0) {
+            return;
+        }
+        const float dx = accel[0] - mf->accel[0];
+        const float dy = accel[1] - mf->accel[1];
+        const float dz = accel[2] - mf->accel[2];
+        const float jerk = sqrtf(dx * dx + dy * dy + dz * dz) / (dTns * 1e-9f);
+        if (jerk > mf->pendingJerk) {
+            mf->pendingJerk = jerk;
+        }
+    }
+    mf->accelTimestamp = timestamp;
+    memcpy(mf->accel, accel, sizeof(mf->accel));
+}
+
+/*
+ * motionFeatures_addSample
+ *
+ *  advances the window by one fused sample. Samples that are not newer
+ *  than the last one (dropped by gyroFunction) are ignored.
+ *
+ * INPUT:
+ *  timestamp: time of the fused sample (ns)
+ *  gyro: angular speed (rad/s)
+ *  orientation: fused azimuth, pitch, roll (rad)
+ * */
+void motionFeatures_addSample(struct motion_features* mf, int64_t timestamp,
+                              const float gyro[], const float orientation[]) {
+    if (timestamp <= mf->timestamp) {
+        return;
+    }
+    mf->timestamp = timestamp;
+
+    // hold the last jerk when no accel sample arrived in between
+    if (mf->pendingJerk >= 0.0f) {
+        mf->jerk = mf->pendingJerk;
+        mf->pendingJerk = -1.0f;
+    }
+
+    struct motion_sample s;
+    s.rateEnergy = gyro[0] * gyro[0] + gyro[1] * gyro[1] + gyro[2] * gyro[2];
+    s.accel = mf->accelTimestamp != 0 ?
+              sqrtf(mf->accel[0] * mf->accel[0] + mf->accel[1] * mf->accel[1] +
+                    mf->accel[2] * mf->accel[2]) - MOTION_GRAVITY : 0.0f;
+    s.jerk = mf->jerk;
+    // up direction in device coordinates, the last row of the rotation
+    // matrix, free of the +-180 degree wrap of the angles
+    const float cosPitch = cosf(orientation[1]);
+    s.gravity[0] = -sinf(orientation[2]) * cosPitch;
+    s.gravity[1] = -sinf(orientation[1]);
+    s.gravity[2] = cosf(orientation[2]) * cosPitch;
+
+    struct motion_sample* slot = &mf->ring[mf->head];
+    if (mf->count == MOTION_WINDOW) {
+        mf->sumRateEnergy -= slot->rateEnergy;
+        mf->sumAccel -= slot->accel;
+        mf->sumAccelSq -= slot->accel * slot->accel;
+        mf->sumJerk -= slot->jerk;
+        mf->sumGravity[0] -= slot->gravity[0];
+        mf->sumGravity[1] -= slot->gravity[1];
+        mf->sumGravity[2] -= slot->gravity[2];
+    } else {
+        mf->count++;
+    }
+    *slot = s;
+    mf->sumRateEnergy += s.rateEnergy;
+    mf->sumAccel += s.accel;
+    mf->sumAccelSq += s.accel * s.accel;
+    mf->sumJerk += s.jerk;
+    mf->sumGravity[0] += s.gravity[0];
+    mf->sumGravity[1] += s.gravity[1];
+    mf->sumGravity[2] += s.gravity[2];
+
+    mf->head = (mf->head + 1) & (MOTION_WINDOW - 1);
+    if (mf->head == 0 && mf->count == MOTION_WINDOW) {
+        recomputeSums(mf);
+    }
+
+    if (++mf->sinceFrame >= mf->hop) {
+        mf->sinceFrame = 0;
+        emitFrame(mf);
+    }
+}
+
+/*
+ * recomputeSums
+ *
+ *  rebuilds the window sums from the ring, once per window so it stays
+ *  O(1) per sample
+ * */
+static void recomputeSums(struct motion_features* mf) {
+    float rateEnergy = 0.0f, accel = 0.0f, accelSq = 0.0f, jerk = 0.0f;
+    float gravity[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < mf->count; i++) {
+        const struct motion_sample* s = &mf->ring[i];
+        rateEnergy += s->rateEnergy;
+        accel += s->accel;
+        accelSq += s->accel * s->accel;
+        jerk += s->jerk;
+        gravity[0] += s->gravity[0];
+        gravity[1] += s->gravity[1];
+        gravity[2] += s->gravity[2];
+    }
+    mf->sumRateEnergy = rateEnergy;
+    mf->sumAccel = accel;
+    mf->sumAccelSq = accelSq;
+    mf->sumJerk = jerk;
+    memcpy(mf->sumGravity, gravity, sizeof(gravity));
+}
+
+/*
+ * emitFrame
+ *
+ *  turns the window sums into a frame and runs the event detectors on it.
+ *  Events are only raised on a full window.
+ * */
+static void emitFrame(struct motion_features* mf) {
+    struct motion_frame frame;
+    const float n = (float) mf->count;
+
+    frame.timestamp = mf->timestamp;
+    frame.rateEnergy = mf->sumRateEnergy / n;
+    const float meanAccel = mf->sumAccel / n;
+    frame.accelVariance = mf->sumAccelSq / n - meanAccel * meanAccel;
+    if (frame.accelVariance < 0.0f) {
+        frame.accelVariance = 0.0f;
+    }
+    frame.jerk = mf->sumJerk / n;
+
+    const float gx = mf->sumGravity[0] / n;
+    const float gy = mf->sumGravity[1] / n;
+    const float gz = mf->sumGravity[2] / n;
+    frame.tiltVariance = 1.0f - sqrtf(gx * gx + gy * gy + gz * gz);
+    if (frame.tiltVariance < 0.0f) {
+        frame.tiltVariance = 0.0f;
+    }
+    frame.gravityZ = gz;
+    frame.samples = (uint16_t) mf->count;
+    frame.events = 0;
+
+    if (mf->count == MOTION_WINDOW) {
+        if (!mf->shaking) {
+            if (frame.rateEnergy > MOTION_SHAKE_RATE_ENERGY &&
+                frame.accelVariance > MOTION_SHAKE_ACCEL_VARIANCE) {
+                mf->shaking = 1;
+                frame.events |= MOTION_EVENT_SHAKE;
+            }
+        } else if (frame.rateEnergy < 0.5f * MOTION_SHAKE_RATE_ENERGY &&
+                   frame.accelVariance < 0.5f * MOTION_SHAKE_ACCEL_VARIANCE) {
+            mf->shaking = 0;
+        }
+
+        int face = 0;
+        if (gz > MOTION_FACE_THRESHOLD) {
+            face = 1;
+        } else if (gz < -MOTION_FACE_THRESHOLD) {
+            face = -1;
+        }
+        if (face != 0) {
+            if (mf->face != 0 && face != mf->face) {
+                frame.events |= MOTION_EVENT_FLIP;
+            }
+            mf->face = face;
+        }
+    }
+
+    if (mf->frame != NULL) {
+        mf->frame(&frame, mf->frameUser);
+    }
+}
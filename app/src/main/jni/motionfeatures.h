@@ -0,0 +1,103 @@
+//
+// Sliding window motion features on the fused sensor stream.
+//
+
+#ifndef NATIVEGYRO_MOTIONFEATURES_H
+#define NATIVEGYRO_MOTIONFEATURES_H
+
+#include <stdint.h>
+
+// samples in the window, a power of two (about 0.6 s of gyro at 200 Hz)
+#define MOTION_WINDOW 128
+// default samples between two frames
+#define MOTION_DEFAULT_HOP 32
+// accel magnitudes are accumulated relative to this to keep the float
+// variance from cancelling out
+#define MOTION_GRAVITY 9.80665f
+
+// shaking starts above both thresholds and ends below half of them
+#define MOTION_SHAKE_RATE_ENERGY 9.0f
+#define MOTION_SHAKE_ACCEL_VARIANCE 9.0f
+// mean gravity z beyond which the device counts as face up / face down
+#define MOTION_FACE_THRESHOLD 0.8f
+
+// frame events
+#define MOTION_EVENT_SHAKE 0x1
+#define MOTION_EVENT_FLIP 0x2
+
+/**
+ * Features of the last MOTION_WINDOW samples, emitted every hop samples.
+ */
+struct motion_frame {
+    int64_t timestamp;
+    // mean squared angular rate (rad^2/s^2)
+    float rateEnergy;
+    // variance of the accel magnitude (m^2/s^4)
+    float accelVariance;
+    // mean accel jerk (m/s^3)
+    float jerk;
+    // circular variance of the gravity direction, 0 steady to 1 tumbling
+    float tiltVariance;
+    // mean z of the gravity direction, 1 face up, -1 face down
+    float gravityZ;
+    uint16_t samples;
+    uint16_t events;
+};
+
+typedef void (*motion_frame_fn)(const struct motion_frame* frame, void* user);
+
+/**
+ * One entry of the ring, the per sample terms of the window sums.
+ */
+struct motion_sample {
+    float rateEnergy;
+    float accel;
+    float jerk;
+    float gravity[3];
+};
+
+/**
+ * Window state.
+ *
+ * Every sample adds its terms to the sums and subtracts the terms of the
+ * sample it overwrites, so a sample is O(1) whatever the window size.
+ * The sums are rebuilt from the ring once per window to drop the float
+ * rounding the add/subtract pairs accumulate.
+ *
+ * Accel arrives on its own queue; the jerk is taken between accel
+ * samples and its peak since the last fused sample goes into the ring.
+ */
+struct motion_features {
+    struct motion_sample ring[MOTION_WINDOW];
+    int32_t head;
+    int32_t count;
+    int32_t hop;
+    int32_t sinceFrame;
+
+    float sumRateEnergy;
+    float sumAccel;
+    float sumAccelSq;
+    float sumJerk;
+    float sumGravity[3];
+
+    int64_t timestamp;
+    int64_t accelTimestamp;
+    float accel[3];
+    float jerk;
+    float pendingJerk;
+
+    int shaking;
+    // 1 face up, -1 face down, 0 neither yet
+    int face;
+
+    motion_frame_fn frame;
+    void* frameUser;
+};
+
+void motionFeatures_init(struct motion_features* mf, int hop,
+                         motion_frame_fn frame, void* frameUser);
+void motionFeatures_addAccel(struct motion_features* mf, int64_t timestamp, const float accel[]);
+void motionFeatures_addSample(struct motion_features* mf, int64_t timestamp,
+                              const float gyro[], const float orientation[]);
+
+#endif //NATIVEGYRO_MOTIONFEATURES_H
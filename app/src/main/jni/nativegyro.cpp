@@ -29,34 +29,33 @@
 #include <android/log.h>
 #include <android_native_app_glue.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "framescheduler.h"
+#include "fusionstate.h"
+#include "magcalibration.h"
+#include "motionfeatures.h"
+#include "sensorfusion.h"
+#ifdef NATIVEGYRO_TRACE
+#include "tracecodec.h"
+#endif
 
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "native-gyro", __VA_ARGS__))
 #define LOGW(...) ((void)__android_log_print(ANDROID_LOG_WARN, "native-gyro", __VA_ARGS__))
 
-#define EPSILON 0.000000001f
-#define NS2S 1.0f / 1000000000.0f
-#define TIME_CONSTANT 30
-#define FILTER_COEFFICIENT 0.98f
-
-/*Func. Prototypes*/
-
-void matrixMultiplication(float A[], float B[], float res[]);
-void getRotationMatrixFromOrientation(float o[],float resultMat[]);
-void sensorManager_getOrientation(float R[],int sizeR,float values[]);
-void sensorManager_getRotationMatrixFromVector(float R[],int sizeR, float rotationVector[],int sizeRV);
-bool sensorManager_getRotationMatrix(float R[],int sizeR, float I[],int sizeI,
-                                     float gravity[], float geomagnetic[]);
-void gyroFunction(struct engine* engine,ASensorEvent event);
-void calculateAccMagOrientation(struct engine* engine);
-void calculateFusedOrientation(struct engine* engine);
-
-/*  Some global variables*/
-float accMagOrientation[3]={0};
-bool accMagOrienttationInit=false;
-bool initState=true;
-int64_t timestamp;
-// final orientation angles from sensor fusion
-float fusedOrientation[3]={0};
+// gyro events read from the queue at once
+#define GYRO_BATCH_SIZE 16
+// batches handled per looper wakeup, about 0.3 s of gyro at 200 Hz
+#define GYRO_MAX_BATCHES 4
+#define MAG_CAL_FILE_NAME "magcal.bin"
+#define FUSION_STATE_FILE_NAME "fusion.bin"
+// one trace per session, named by its wall clock start in ms, so a
+// restart never truncates a trace that was not shipped yet
+#define TRACE_FILE_FORMAT "trace-%lld.ngt"
+// looper ident of the frame deadline timer
+#define LOOPER_ID_FRAME (LOOPER_ID_USER + 1)
 
 /**
  * Our saved state data.
@@ -71,6 +70,9 @@ struct saved_state {
  * Shared state for our app.
  */
 struct engine {
+    // hot state first, the cold state below is only used by commands
+    struct fusion_context fusion;
+
     struct android_app* app;
 
     ASensorManager* sensorManager;
@@ -81,19 +83,23 @@ struct engine {
     ASensorEventQueue* sensorEventQueueGyro;
     ASensorEventQueue* sensorEventQueueMag;
 
-    // angular speeds from gyro
-    float gyro[3];
-    // rotation matrix from gyro data
-    float gyroMatrix[9];
-    float gyroOrientation[3];
-    // accelerometer and magnetometer based rotation matrix
-    float rotationMatrix[9];
-    // magnetic field vector
-    float magnet[3];
-    // accelerometer vector
-    float accel[3];
+    // online magnetometer calibration
+    struct mag_calibration magCal;
+    // windowed motion features on the fused stream
+    struct motion_features motion;
+#ifdef NATIVEGYRO_TRACE
+    // raw sensor recording, NULL if the trace could not be opened
+    struct trace_encoder* trace;
+#endif
+
+    // startup metric: time to the first fused orientation
+    int64_t startTime;
+    int warmStart;
+    int firstOrientationLogged;
 
     int animating;
+    // paces the drawing while animating
+    struct frame_scheduler frames;
     EGLDisplay display;
     EGLSurface surface;
     EGLContext context;
@@ -102,6 +108,88 @@ struct engine {
     struct saved_state state;
 };
 
+/**
+ * Build the path of a file in the app's internal data directory.
+ */
+static bool engine_data_path(struct engine* engine, const char* name, char* path, size_t size) {
+    const char* dir = engine->app->activity->internalDataPath;
+    if (dir == NULL) {
+        return false;
+    }
+    int n = snprintf(path, size, "%s/%s", dir, name);
+    return n > 0 && (size_t) n < size;
+}
+
+/**
+ * Snapshot the fusion state for a later warm start.
+ */
+static void engine_capture_fusion(struct engine* engine, struct fusion_state* fs) {
+    const struct fusion_context* ctx = &engine->fusion;
+    memset(fs, 0, sizeof(*fs));
+#ifdef NATIVEGYRO_FIXED_POINT
+    fixedFusion_getMatrix(&ctx->fixed, fs->gyroMatrix);
+#else
+    memcpy(fs->gyroMatrix, ctx->gyroMatrix, sizeof(fs->gyroMatrix));
+#endif
+    memcpy(fs->accMagOrientation, ctx->accMagOrientation, sizeof(fs->accMagOrientation));
+    memcpy(fs->fusedOrientation, ctx->fusedOrientation, sizeof(fs->fusedOrientation));
+    fs->flags = ctx->accMagOrientationInit ? FUSION_STATE_ACCMAG_VALID : 0;
+    fusionState_seal(fs, fusionState_now());
+}
+
+/**
+ * Continue from a validated fusion state instead of starting cold.
+ */
+static void engine_restore_fusion(struct engine* engine, const struct fusion_state* fs) {
+    struct fusion_context* ctx = &engine->fusion;
+    // saved before the first acc/mag orientation, there is nothing to
+    // continue from
+    if (!(fs->flags & FUSION_STATE_ACCMAG_VALID)) {
+        return;
+    }
+#ifdef NATIVEGYRO_FIXED_POINT
+    fixedFusion_setMatrix(&ctx->fixed, fs->gyroMatrix);
+#else
+    memcpy(ctx->gyroMatrix, fs->gyroMatrix, sizeof(ctx->gyroMatrix));
+#endif
+    memcpy(ctx->gyroOrientation, fs->fusedOrientation, sizeof(ctx->gyroOrientation));
+    memcpy(ctx->accMagOrientation, fs->accMagOrientation, sizeof(ctx->accMagOrientation));
+    memcpy(ctx->fusedOrientation, fs->fusedOrientation, sizeof(ctx->fusedOrientation));
+    ctx->accMagOrientationInit = 1;
+    ctx->initState = 0;
+    // the sensor queue restarts, so the first new sample only re-arms the
+    // integration instead of integrating across the restart
+    ctx->timestamp = 0;
+    engine->warmStart = 1;
+}
+
+/**
+ * Write the fusion state to disk so it survives the process.
+ */
+static void engine_persist_fusion(struct engine* engine, const struct fusion_state* fs) {
+    char path[256];
+    if (engine_data_path(engine, FUSION_STATE_FILE_NAME, path, sizeof(path)) &&
+        !fusionState_save(path, fs)) {
+        LOGW("Unable to save fusion state");
+    }
+}
+
+/**
+ * Log a motion feature frame, and its events, for the feature consumers.
+ */
+static void engine_motion_frame(const struct motion_frame* frame, void* user) {
+    LOGI("motion: t=%lld energy=%f accelVar=%f jerk=%f tiltVar=%f gravityZ=%f n=%d",
+         (long long) frame->timestamp, frame->rateEnergy, frame->accelVariance,
+         frame->jerk, frame->tiltVariance, frame->gravityZ, frame->samples);
+    if (frame->events & MOTION_EVENT_SHAKE) {
+        LOGI("motion event: shake t=%lld", (long long) frame->timestamp);
+    }
+    if (frame->events & MOTION_EVENT_FLIP) {
+        LOGI("motion event: flip t=%lld face %s", (long long) frame->timestamp,
+             frame->gravityZ > 0 ? "up" : "down");
+    }
+}
+
 /**
  * Initialize an EGL context for the current display.
  */
@@ -229,9 +317,22 @@ static void engine_handle_cmd(struct android_app* app, int32_t cmd) {
     switch (cmd) {
         case APP_CMD_SAVE_STATE:
             // The system has asked us to save our current state.  Do so.
-            engine->app->savedState = malloc(sizeof(struct saved_state));
-            *((struct saved_state*)engine->app->savedState) = engine->state;
-            engine->app->savedStateSize = sizeof(struct saved_state);
+            // The fusion state is appended once the gyro has been initialized.
+            if (!engine->fusion.initState) {
+                struct fusion_state fusion;
+                engine_capture_fusion(engine, &fusion);
+                engine_persist_fusion(engine, &fusion);
+
+                engine->app->savedState = malloc(sizeof(struct saved_state) + sizeof(fusion));
+                *((struct saved_state*)engine->app->savedState) = engine->state;
+                memcpy((char*)engine->app->savedState + sizeof(struct saved_state),
+                       &fusion, sizeof(fusion));
+                engine->app->savedStateSize = sizeof(struct saved_state) + sizeof(fusion);
+            } else {
+                engine->app->savedState = malloc(sizeof(struct saved_state));
+                *((struct saved_state*)engine->app->savedState) = engine->state;
+                engine->app->savedStateSize = sizeof(struct saved_state);
+            }
             break;
         case APP_CMD_INIT_WINDOW:
             // The window is being shown, get it ready.
@@ -284,8 +385,31 @@ static void engine_handle_cmd(struct android_app* app, int32_t cmd) {
             }
             if(engine->magSensor !=NULL){
                 ASensorEventQueue_disableSensor(engine->sensorEventQueueMag,
-                                                engine->gyroSensor);
+                                                engine->magSensor);
             }
+            // Keep the magnetometer calibration so it doesn't have to converge again.
+            {
+                char path[256];
+                if (engine_data_path(engine, MAG_CAL_FILE_NAME, path, sizeof(path)) &&
+                    !magCalibration_save(&engine->magCal, path)) {
+                    LOGW("Unable to save magnetometer calibration");
+                }
+            }
+            if (!engine->fusion.initState) {
+                struct fusion_state fusion;
+                engine_capture_fusion(engine, &fusion);
+                engine_persist_fusion(engine, &fusion);
+            }
+#ifdef NATIVEGYRO_TRACE
+            if (engine->trace != NULL) {
+                traceEncoder_flush(engine->trace);
+            }
+#endif
+            LOGI("gyro gaps: duplicates=%u outOfOrder=%u substepped=%u (%u steps) resets=%u "
+                 "skipped=%u",
+                 engine->fusion.metrics.duplicates, engine->fusion.metrics.outOfOrder,
+                 engine->fusion.metrics.substepped, engine->fusion.metrics.substeps,
+                 engine->fusion.metrics.resets, engine->fusion.metrics.skippedGaps);
             // Also stop animating.
             engine->animating = 0;
             engine_draw_frame(engine);
@@ -309,6 +433,7 @@ void android_main(struct android_app* state) {
     state->onAppCmd = engine_handle_cmd;
     state->onInputEvent = engine_handle_input;
     engine.app = state;
+    engine.startTime = fusionState_now();
 
     // Prepare to monitor accelerometer
     engine.sensorManager = ASensorManager_getInstance();
@@ -317,8 +442,8 @@ void android_main(struct android_app* state) {
                                                                  ASENSOR_TYPE_ACCELEROMETER);
     engine.gyroSensor = ASensorManager_getDefaultSensor(engine.sensorManager,
                                                                  ASENSOR_TYPE_GYROSCOPE);
-    engine.gyroSensor = ASensorManager_getDefaultSensor(engine.sensorManager,
-                                                        ASENSOR_TYPE_MAGNETIC_FIELD);
+    engine.magSensor = ASensorManager_getDefaultSensor(engine.sensorManager,
+                                                       ASENSOR_TYPE_MAGNETIC_FIELD);
     engine.sensorEventQueue = ASensorManager_createEventQueue(engine.sensorManager,
                                                               state->looper, LOOPER_ID_USER, NULL, NULL);
     engine.sensorEventQueueGyro = ASensorManager_createEventQueue(engine.sensorManager,
@@ -328,15 +453,92 @@ void android_main(struct android_app* state) {
 
     //init gyro
 
-    engine.gyroMatrix[0] = 1.0f; engine.gyroMatrix[1] = 0.0f; engine.gyroMatrix[2] = 0.0f;
-    engine.gyroMatrix[3] = 0.0f; engine.gyroMatrix[4] = 1.0f; engine.gyroMatrix[5] = 0.0f;
-    engine.gyroMatrix[6] = 0.0f; engine.gyroMatrix[7] = 0.0f; engine.gyroMatrix[8] = 1.0f;
+    engine.fusion.initState = 1;
+#ifdef NATIVEGYRO_FIXED_POINT
+    fixedFusion_init(&engine.fusion.fixed);
+#else
+    engine.fusion.gyroMatrix[0] = 1.0f; engine.fusion.gyroMatrix[1] = 0.0f; engine.fusion.gyroMatrix[2] = 0.0f;
+    engine.fusion.gyroMatrix[3] = 0.0f; engine.fusion.gyroMatrix[4] = 1.0f; engine.fusion.gyroMatrix[5] = 0.0f;
+    engine.fusion.gyroMatrix[6] = 0.0f; engine.fusion.gyroMatrix[7] = 0.0f; engine.fusion.gyroMatrix[8] = 1.0f;
+#endif
+
+    //init magnetometer calibration, continue from the last run if possible
+
+    magCalibration_init(&engine.magCal);
+    {
+        char path[256];
+        if (engine_data_path(&engine, MAG_CAL_FILE_NAME, path, sizeof(path)) &&
+            magCalibration_load(&engine.magCal, path)) {
+            LOGI("magnetometer calibration loaded: valid=%d field=%f",
+                 engine.magCal.valid, engine.magCal.fieldStrength);
+        }
+    }
+
+    motionFeatures_init(&engine.motion, MOTION_DEFAULT_HOP, engine_motion_frame, &engine);
 
     if (state->savedState != NULL) {
         // We are starting with a previous saved state; restore from it.
         engine.state = *(struct saved_state*)state->savedState;
     }
 
+    // warm start the fusion from the saved state, or from disk if the
+    // process was killed, as long as the state is recent enough
+    {
+        struct fusion_state fusion;
+        char path[256];
+        if (state->savedState != NULL &&
+            state->savedStateSize > sizeof(struct saved_state) &&
+            fusionState_validate((char*)state->savedState + sizeof(struct saved_state),
+                                 state->savedStateSize - sizeof(struct saved_state),
+                                 engine.startTime, &fusion)) {
+            engine_restore_fusion(&engine, &fusion);
+        } else if (engine_data_path(&engine, FUSION_STATE_FILE_NAME, path, sizeof(path)) &&
+                   fusionState_load(path, engine.startTime, &fusion)) {
+            engine_restore_fusion(&engine, &fusion);
+        }
+        LOGI("fusion %s start", engine.warmStart ? "warm" : "cold");
+    }
+
+#ifdef NATIVEGYRO_TRACE
+    {
+        char name[64];
+        char path[256];
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        snprintf(name, sizeof(name), TRACE_FILE_FORMAT,
+                 (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+        engine.trace = (struct trace_encoder*) malloc(sizeof(struct trace_encoder));
+        if (engine.trace != NULL &&
+            (!engine_data_path(&engine, name, path, sizeof(path)) ||
+             !traceEncoder_open(engine.trace, path))) {
+            LOGW("Unable to open sensor trace");
+            free(engine.trace);
+            engine.trace = NULL;
+        }
+        if (engine.trace != NULL) {
+            if (engine.accelerometerSensor != NULL)
+                traceEncoder_setResolution(engine.trace, TRACE_SENSOR_ACCEL,
+                                           ASensor_getResolution(engine.accelerometerSensor));
+            if (engine.gyroSensor != NULL)
+                traceEncoder_setResolution(engine.trace, TRACE_SENSOR_GYRO,
+                                           ASensor_getResolution(engine.gyroSensor));
+            if (engine.magSensor != NULL)
+                traceEncoder_setResolution(engine.trace, TRACE_SENSOR_MAG,
+                                           ASensor_getResolution(engine.magSensor));
+        }
+    }
+#endif
+
+    frameScheduler_init(&engine.frames, FRAME_PERIOD_NS, frameScheduler_monotonicClock, NULL);
+    if (frameScheduler_openTimer(&engine.frames) &&
+        ALooper_addFd(state->looper, engine.frames.timerFd, LOOPER_ID_FRAME,
+                      ALOOPER_EVENT_INPUT, NULL, NULL) != 1) {
+        // nothing would wake the loop for the timer, pace with the poll
+        // timeout instead
+        LOGW("frame timer not added to the looper");
+        frameScheduler_closeTimer(&engine.frames);
+    }
+
     // loop waiting for stuff to do.
 
     while (1) {
@@ -345,10 +547,16 @@ void android_main(struct android_app* state) {
         int events;
         struct android_poll_source* source;
 
-        // If not animating, we will block forever waiting for events.
-        // If animating, we loop until all events are read, then continue
-        // to draw the next frame of animation.
-        while ((ident=ALooper_pollAll(engine.animating ? 0 : -1, NULL, &events,
+        if (engine.animating) {
+            frameScheduler_start(&engine.frames);
+        } else {
+            frameScheduler_stop(&engine.frames);
+        }
+
+        // Sleep until the next event or the next frame deadline, whichever
+        // comes first. If not animating, there is no deadline and we block
+        // until an event arrives.
+        while ((ident=ALooper_pollAll(frameScheduler_pollTimeout(&engine.frames), NULL, &events,
                                       (void**)&source)) >= 0) {
 
             // Process this event.
@@ -356,6 +564,10 @@ void android_main(struct android_app* state) {
                 source->process(state, source);
             }
 
+            if (ident == LOOPER_ID_FRAME) {
+                frameScheduler_ackTimer(&engine.frames);
+            }
+
             // If a sensor has data, process it now.
             if (ident == LOOPER_ID_USER) {
 
@@ -367,44 +579,94 @@ void android_main(struct android_app* state) {
                        /* LOGI("accelerometer: x=%f y=%f z=%f",
                              event.acceleration.x, event.acceleration.y,
                              event.acceleration.z);*/
-                        engine.accel[0] = event.acceleration.x;
-                        engine.accel[1] = event.acceleration.y;
-                        engine.accel[2] = event.acceleration.z;
-
-                        calculateAccMagOrientation(&engine);
+                        engine.fusion.accel[0] = event.acceleration.x;
+                        engine.fusion.accel[1] = event.acceleration.y;
+                        engine.fusion.accel[2] = event.acceleration.z;
+#ifdef NATIVEGYRO_TRACE
+                        if (engine.trace != NULL)
+                            traceEncoder_add(engine.trace, TRACE_SENSOR_ACCEL, event.timestamp,
+                                             event.acceleration.x, event.acceleration.y,
+                                             event.acceleration.z);
+#endif
+
+                        calculateAccMagOrientation(&engine.fusion);
+                        motionFeatures_addAccel(&engine.motion, event.timestamp,
+                                                engine.fusion.accel);
 
                     }
                 }
                 if(engine.gyroSensor != NULL){
-                    ASensorEvent event;
-
-                    while(ASensorEventQueue_getEvents(engine.sensorEventQueueGyro,
-                                                        &event,1) > 0){
-
-                        gyroFunction(&engine,event);
-                        calculateFusedOrientation(&engine);
+                    ASensorEvent gyroEvents[GYRO_BATCH_SIZE];
+                    ssize_t count;
+                    int batches = 0;
+
+                    // a backlog after a stall is worked off a few batches per
+                    // wakeup, the per sample cost is bounded by the substep
+                    // limit. The queue stays readable, so the looper comes
+                    // back to the rest after accel/mag, input and frames.
+                    while(batches < GYRO_MAX_BATCHES &&
+                          (count = ASensorEventQueue_getEvents(engine.sensorEventQueueGyro,
+                                                               gyroEvents, GYRO_BATCH_SIZE)) > 0){
+                        batches++;
+
+                        for (ssize_t i = 0; i < count; i++) {
+#ifdef NATIVEGYRO_TRACE
+                            if (engine.trace != NULL)
+                                traceEncoder_add(engine.trace, TRACE_SENSOR_GYRO,
+                                                 gyroEvents[i].timestamp, gyroEvents[i].vector.x,
+                                                 gyroEvents[i].vector.y, gyroEvents[i].vector.z);
+#endif
+                            // arming, duplicate and out of order samples leave
+                            // the state as it is, fusing them again would pull
+                            // the output towards acc/mag once more
+                            if (!gyroFunction(&engine.fusion, gyroEvents[i].timestamp,
+                                              gyroEvents[i].vector.v))
+                                continue;
+                            calculateFusedOrientation(&engine.fusion);
+                            motionFeatures_addSample(&engine.motion, engine.fusion.timestamp,
+                                                     engine.fusion.gyro,
+                                                     engine.fusion.fusedOrientation);
+
+                            if (!engine.firstOrientationLogged &&
+                                engine.fusion.accMagOrientationInit) {
+                                engine.firstOrientationLogged = 1;
+                                LOGI("first orientation after %.1f ms (%s start)",
+                                     (fusionState_now() - engine.startTime) / 1000000.0,
+                                     engine.warmStart ? "warm" : "cold");
+                            }
+                        }
                         // GyroOrientation buradan sonra hazır.
                         //üstteki iki fonksiyon sensor verisi ile çalışıp sonucu döndürür.
 
                         LOGI("gyro: x=%f y=%f z=%f",
-                             engine.gyroOrientation[0]* 180/M_PI,
-                             engine.gyroOrientation[1]* 180/M_PI,
-                             engine.gyroOrientation[2]* 180/M_PI);
+                             engine.fusion.gyroOrientation[0]* 180/M_PI,
+                             engine.fusion.gyroOrientation[1]* 180/M_PI,
+                             engine.fusion.gyroOrientation[2]* 180/M_PI);
 
                       /*  LOGI("gyro: x=%f y=%f z=%f",
                              event.vector.x, event.vector.y,
                              event.vector.z);*/
                     }
                 }
-                if(engine.gyroSensor != NULL){
+                if(engine.magSensor != NULL){
                     ASensorEvent event;
 
                     while(ASensorEventQueue_getEvents(engine.sensorEventQueueMag,
                                                       &event,1) > 0){
 
-                        engine.magnet[0] = event.magnetic.x;
-                        engine.magnet[1] = event.magnetic.y;
-                        engine.magnet[2] = event.magnetic.z;
+                        float raw[3];
+                        raw[0] = event.magnetic.x;
+                        raw[1] = event.magnetic.y;
+                        raw[2] = event.magnetic.z;
+#ifdef NATIVEGYRO_TRACE
+                        if (engine.trace != NULL)
+                            traceEncoder_add(engine.trace, TRACE_SENSOR_MAG, event.timestamp,
+                                             raw[0], raw[1], raw[2]);
+#endif
+
+                        // calibrate before the vector reaches calculateAccMagOrientation
+                        magCalibration_addSample(&engine.magCal, raw);
+                        magCalibration_apply(&engine.magCal, raw, engine.fusion.magnet);
 
                     }
                 }
@@ -413,427 +675,38 @@ void android_main(struct android_app* state) {
             // Check if we are exiting.
             if (state->destroyRequested != 0) {
                 engine_term_display(&engine);
+                if (engine.frames.timerFd >= 0) {
+                    ALooper_removeFd(state->looper, engine.frames.timerFd);
+                    frameScheduler_closeTimer(&engine.frames);
+                }
+#ifdef NATIVEGYRO_TRACE
+                if (engine.trace != NULL) {
+                    traceEncoder_close(engine.trace);
+                    free(engine.trace);
+                }
+#endif
                 return;
             }
+
+            // Animation started or stopped while handling the event,
+            // or it is time for the next frame.
+            if (engine.animating != engine.frames.running ||
+                frameScheduler_due(&engine.frames)) {
+                break;
+            }
         }
 
-        if (engine.animating) {
+        if (engine.animating && frameScheduler_due(&engine.frames)) {
             // Done with events; draw next animation frame.
             engine.state.angle += .01f;
             if (engine.state.angle > 1) {
                 engine.state.angle = 0;
             }
 
-            // Drawing is throttled to the screen update rate, so there
-            // is no need to do timing here.
+            // eglSwapBuffers returns at about the vsync, the next
+            // deadline is placed one period after that.
             engine_draw_frame(&engine);
+            frameScheduler_frameDone(&engine.frames);
         }
     }
 }
-
-//////!!!! BURADAN SONRASI GYRO JITTER EFEKTI DUZELTMEKE ICIN GEREKLI FONKLAR ICIN ///////////
-
-// This function is borrowed from the Android reference
-// at http://developer.android.com/reference/android/hardware/SensorEvent.html#values
-// It calculates a rotation vector from the gyroscope angular speed values.
-
-void getRotationVectorFromGyro(float gyroValues[],
-                               float deltaRotationVector[],
-                               float timeFactor) {
-        float normValues[3];
-
-        // Calculate the angular speed of the sample
-        float omegaMagnitude = sqrtf(gyroValues[0] * gyroValues[0] +
-                                     gyroValues[1] * gyroValues[1] +
-                                     gyroValues[2] * gyroValues[2]);
-        // Normalize the rotation vector if it's big enough to get the axis
-        if(omegaMagnitude > EPSILON){
-            normValues[0] = gyroValues[0] / omegaMagnitude;
-            normValues[1] = gyroValues[1] / omegaMagnitude;
-            normValues[2] = gyroValues[2] / omegaMagnitude;
-        }
-        // Integrate around this axis with the angular speed by the timestep
-        // in order to get a delta rotation from this sample over the timestep
-        // We will convert this axis-angle representation of the delta rotation
-        // into a quaternion before turning it into the rotation matrix.
-        float thetaOverTwo = omegaMagnitude * timeFactor;
-        float sinThetaOverTwo = sinf(thetaOverTwo);
-        float cosThetaOverTwo = cosf(thetaOverTwo);
-
-        deltaRotationVector[0] = sinThetaOverTwo * normValues[0];
-        deltaRotationVector[1] = sinThetaOverTwo * normValues[1];
-        deltaRotationVector[2] = sinThetaOverTwo * normValues[2];
-        deltaRotationVector[3] = cosThetaOverTwo;
-
-}
-
-void gyroFunction(struct engine* engine,ASensorEvent event) {
-    // don't start until first accelerometer/magnetometer orientation has been acquired
-/*
-    if(!accMagOrienttationInit)
-        return;
-*/
-    // initialisation of the gyroscope based rotation matrix
-    if(initState) {
-            float initMatrix[9];
-            getRotationMatrixFromOrientation(accMagOrientation,initMatrix);
-            float test[3];
-
-            sensorManager_getOrientation(initMatrix,9, test);
-
-            matrixMultiplication(engine->gyroMatrix, initMatrix,engine->gyroMatrix);
-
-//            LOGI("initgyroMatrix: d0=%f d1=%f d2=%f d3=%f d4=%f d5=%f d6=%f d7=%f d8=%f",
-//             engine->gyroMatrix[0],engine->gyroMatrix[1],engine->gyroMatrix[2],
-//             engine->gyroMatrix[3],engine->gyroMatrix[4],engine->gyroMatrix[5],
-//             engine->gyroMatrix[6],engine->gyroMatrix[7],engine->gyroMatrix[8]);
-
-            initState = false;
-        }
-
-            // copy the new gyro values into the gyro array
-            // convert the raw gyro data into a rotation vector
-            float deltaVector[4];
-            if(timestamp != 0) {
-                const float dT = (event.timestamp - timestamp) * NS2S;
-
-                engine->gyro[0] = event.vector.x;
-                engine->gyro[1] = event.vector.y;
-                engine->gyro[2] = event.vector.z;
-
-                getRotationVectorFromGyro(engine->gyro, deltaVector, dT / 2.0f);
-            }
-
-            // measurement done, save current time for next interval
-            timestamp = event.timestamp;
-
-            // convert rotation vector into rotation matrix
-            float deltaMatrix[9];
-
-            sensorManager_getRotationMatrixFromVector(deltaMatrix,9,deltaVector,4);
-
-//          LOGI("deltaMatrix: d0=%f d1=%f d2=%f d3=%f d4=%f d5=%f d6=%f d7=%f d8=%f",
-//          deltaMatrix[0],deltaMatrix[1],deltaMatrix[2],deltaMatrix[3],deltaMatrix[4],
-//          deltaMatrix[5],deltaMatrix[6],deltaMatrix[7],deltaMatrix[8]);
-
-            // apply the new rotation interval on the gyroscope based rotation matrix
-            matrixMultiplication(engine->gyroMatrix, deltaMatrix,engine->gyroMatrix);
-           /* LOGI("gyroMatrix: d0=%f d1=%f d2=%f d3=%f d4=%f d5=%f d6=%f d7=%f d8=%f",
-                 engine->gyroMatrix[0],engine->gyroMatrix[1],engine->gyroMatrix[2],
-                 engine->gyroMatrix[3],engine->gyroMatrix[4],engine->gyroMatrix[5],
-                 engine->gyroMatrix[6],engine->gyroMatrix[7],engine->gyroMatrix[8]);*/
-
-            // get the gyroscope based orientation from the rotation matrix
-            //SensorManager.getOrientation(engine->gyroMatrix, gyroOrientation);
-            sensorManager_getOrientation(engine->gyroMatrix,9,engine->gyroOrientation);
-        }
-
-
-void getRotationMatrixFromOrientation(float o[],float resultMat[]) {
-        float xM[9];
-        float yM[9];
-        float zM[9];
-
-        float sinX = sinf(o[1]);
-        float cosX = cosf(o[1]);
-        float sinY = sinf(o[2]);
-        float cosY = cosf(o[2]);
-        float sinZ = sinf(o[0]);
-        float cosZ = cosf(o[0]);
-
-        // rotation about x-axis (pitch)
-        xM[0] = 1.0f; xM[1] = 0.0f; xM[2] = 0.0f;
-        xM[3] = 0.0f; xM[4] = cosX; xM[5] = sinX;
-        xM[6] = 0.0f; xM[7] = -sinX; xM[8] = cosX;
-
-        // rotation about y-axis (roll)
-        yM[0] = cosY; yM[1] = 0.0f; yM[2] = sinY;
-        yM[3] = 0.0f; yM[4] = 1.0f; yM[5] = 0.0f;
-        yM[6] = -sinY; yM[7] = 0.0f; yM[8] = cosY;
-
-        // rotation about z-axis (azimuth)
-        zM[0] = cosZ; zM[1] = sinZ; zM[2] = 0.0f;
-        zM[3] = -sinZ; zM[4] = cosZ; zM[5] = 0.0f;
-        zM[6] = 0.0f; zM[7] = 0.0f; zM[8] = 1.0f;
-
-        // rotation order is y, x, z (roll, pitch, azimuth)
-        float resultMatrix[9];
-        matrixMultiplication(xM, yM,resultMatrix);
-        matrixMultiplication(zM, resultMatrix,resultMatrix);
-        memcpy(resultMat,resultMatrix, sizeof(resultMatrix));
-
-    }
-
-/*
- *  matrixMultiplication
- *
- *  it does multiplication for 3x3 matricies
- *
- *  INPUT:
- *   A: 3x3 matrix for first operand
- *   B: 3x3 matrix for second operand
- *
- *   OUTPUT:
- *   res: 3x3 matrix result of mulptiplication
- * */
-void matrixMultiplication(float A[], float B[], float res[]) {
-        float result[9];
-
-        result[0] = A[0] * B[0] + A[1] * B[3] + A[2] * B[6];
-        result[1] = A[0] * B[1] + A[1] * B[4] + A[2] * B[7];
-        result[2] = A[0] * B[2] + A[1] * B[5] + A[2] * B[8];
-
-        result[3] = A[3] * B[0] + A[4] * B[3] + A[5] * B[6];
-        result[4] = A[3] * B[1] + A[4] * B[4] + A[5] * B[7];
-        result[5] = A[3] * B[2] + A[4] * B[5] + A[5] * B[8];
-
-        result[6] = A[6] * B[0] + A[7] * B[3] + A[8] * B[6];
-        result[7] = A[6] * B[1] + A[7] * B[4] + A[8] * B[7];
-        result[8] = A[6] * B[2] + A[7] * B[5] + A[8] * B[8];
-
-        memcpy(res,result,sizeof(result));
-
-    }
-
-//accelerometer
-/*
- * calculateAccMagOrientation
- *
- *  calculates orientation from rotation matrix that calculated with Accelerometer and magnatic field vectors
- *
- * INPUT:
- *  engine: strucut that contains accel and mag. field vectors
- *
- * */
-void calculateAccMagOrientation(struct engine* engine) {
-
-    if(sensorManager_getRotationMatrix(engine->rotationMatrix,9, NULL ,0, engine->accel,engine->magnet)) {
-            sensorManager_getOrientation(engine->rotationMatrix,9,accMagOrientation);
-            if(!accMagOrienttationInit)
-                accMagOrienttationInit=true;
-	    }
-
-}
-
-/*
- * calculateFusedOrientation
- *
- *  makes calculate for fix jitter effect.
- *
- * INPUT:
- *  engine: struct that contains gyroMatrix, gyroOrientation
- *
- * */
-
-void calculateFusedOrientation(struct engine* engine){
-    float oneMinusCoeff = 1.0f - FILTER_COEFFICIENT;
-
-    /*
-     * Fix for 179° <--> -179° transition problem:
-     * Check whether one of the two orientation angles (gyro or accMag) is negative while the other one is positive.
-     * If so, add 360° (2 * math.PI) to the negative value, perform the sensor fusion, and remove the 360° from the result
-     * if it is greater than 180°. This stabilizes the output in positive-to-negative-transition cases.
-     */
-
-    // azimuth
-    if (engine->gyroOrientation[0] < -0.5 * M_PI && accMagOrientation[0] > 0.0) {
-        fusedOrientation[0] = (float) (FILTER_COEFFICIENT * (engine->gyroOrientation[0] + 2.0 * M_PI) + oneMinusCoeff * accMagOrientation[0]);
-        fusedOrientation[0] -= (fusedOrientation[0] > M_PI) ? 2.0 * M_PI : 0;
-    }
-    else if (accMagOrientation[0] < -0.5 * M_PI && engine->gyroOrientation[0] > 0.0) {
-        fusedOrientation[0] = (float) (FILTER_COEFFICIENT * engine->gyroOrientation[0] + oneMinusCoeff * (accMagOrientation[0] + 2.0 * M_PI));
-        fusedOrientation[0] -= (fusedOrientation[0] > M_PI)? 2.0 * M_PI : 0;
-    }
-    else {
-        fusedOrientation[0] = FILTER_COEFFICIENT * engine->gyroOrientation[0] + oneMinusCoeff * accMagOrientation[0];
-    }
-
-    // pitch
-    if (engine->gyroOrientation[1] < -0.5 * M_PI && accMagOrientation[1] > 0.0) {
-        fusedOrientation[1] = (float) (FILTER_COEFFICIENT * (engine->gyroOrientation[1] + 2.0 * M_PI) + oneMinusCoeff * accMagOrientation[1]);
-        fusedOrientation[1] -= (fusedOrientation[1] > M_PI) ? 2.0 * M_PI : 0;
-    }
-    else if (accMagOrientation[1] < -0.5 * M_PI && engine->gyroOrientation[1] > 0.0) {
-        fusedOrientation[1] = (float) (FILTER_COEFFICIENT * engine->gyroOrientation[1] + oneMinusCoeff * (accMagOrientation[1] + 2.0 * M_PI));
-        fusedOrientation[1] -= (fusedOrientation[1] > M_PI)? 2.0 * M_PI : 0;
-    }
-    else {
-        fusedOrientation[1] = FILTER_COEFFICIENT * engine->gyroOrientation[1] + oneMinusCoeff * accMagOrientation[1];
-    }
-
-    // roll
-    if (engine->gyroOrientation[2] < -0.5 * M_PI && accMagOrientation[2] > 0.0) {
-        fusedOrientation[2] = (float) (FILTER_COEFFICIENT * (engine->gyroOrientation[2] + 2.0 * M_PI) + oneMinusCoeff * accMagOrientation[2]);
-        fusedOrientation[2] -= (fusedOrientation[2] > M_PI) ? 2.0 * M_PI : 0;
-    }
-    else if (accMagOrientation[2] < -0.5 * M_PI && engine->gyroOrientation[2] > 0.0) {
-        fusedOrientation[2] = (float) (FILTER_COEFFICIENT * engine->gyroOrientation[2] + oneMinusCoeff * (accMagOrientation[2] + 2.0 * M_PI));
-        fusedOrientation[2] -= (fusedOrientation[2] > M_PI)? 2.0 * M_PI : 0;
-    }
-    else {
-        fusedOrientation[2] = FILTER_COEFFICIENT * engine->gyroOrientation[2] + oneMinusCoeff * accMagOrientation[2];
-    }
-
-    // overwrite gyro matrix and orientation with fused orientation
-    // to comensate gyro drift
-    //gyroMatrix = getRotationMatrixFromOrientation(fusedOrientation);
-    getRotationMatrixFromOrientation(fusedOrientation,engine->gyroMatrix);
-    //System.arraycopy(fusedOrientation, 0, gyroOrientation, 0, 3);
-    memcpy(engine->gyroOrientation,fusedOrientation,sizeof(fusedOrientation));
-
-}
-
-
-
-// Sensor Manager Functions that not avaible in sensor.h in NDK
-
-// SensorManager getorientation func
-
-void sensorManager_getOrientation(float R[],int sizeR,float values[]){
-
-    /*
-        * 4x4 (length=16) case:
-        *   /  R[ 0]   R[ 1]   R[ 2]   0  \
-        *   |  R[ 4]   R[ 5]   R[ 6]   0  |
-        *   |  R[ 8]   R[ 9]   R[10]   0  |
-        *   \      0       0       0   1  /
-        *
-        * 3x3 (length=9) case:
-        *   /  R[ 0]   R[ 1]   R[ 2]  \
-        *   |  R[ 3]   R[ 4]   R[ 5]  |
-        *   \  R[ 6]   R[ 7]   R[ 8]  /
-        *
-        */
-        if (sizeR == 9) {
-            values[0] = atan2f(R[1], R[4]);
-            values[1] = asinf(-R[7]);
-            values[2] = atan2f(-R[6], R[8]);
-        } else {
-            values[0] = atan2f(R[1], R[5]);
-            values[1] = asinf(-R[9]);
-            values[2] = atan2f(-R[8], R[10]);
-        }
-}
-
-void sensorManager_getRotationMatrixFromVector(float R[],int sizeR, float rotationVector[],int sizeRV) {
-            float q0;
-            float q1 = rotationVector[0];
-            float q2 = rotationVector[1];
-            float q3 = rotationVector[2];
-
-         if (sizeRV == 4) {
-                  q0 = rotationVector[3];
-         } else {
-               q0 = 1 - q1*q1 - q2*q2 - q3*q3;
-                q0 = (q0 > 0) ? sqrtf(q0) : 0;
-         }
-
-        float sq_q1 = 2 * q1 * q1;
-        float sq_q2 = 2 * q2 * q2;
-        float sq_q3 = 2 * q3 * q3;
-        float q1_q2 = 2 * q1 * q2;
-        float q3_q0 = 2 * q3 * q0;
-        float q1_q3 = 2 * q1 * q3;
-        float q2_q0 = 2 * q2 * q0;
-        float q2_q3 = 2 * q2 * q3;
-        float q1_q0 = 2 * q1 * q0;
-
-        if(sizeR == 9) {
-            R[0] = 1 - sq_q2 - sq_q3;
-            R[1] = q1_q2 - q3_q0;
-            R[2] = q1_q3 + q2_q0;
-
-            R[3] = q1_q2 + q3_q0;
-            R[4] = 1 - sq_q1 - sq_q3;
-            R[5] = q2_q3 - q1_q0;
-
-            R[6] = q1_q3 - q2_q0;
-            R[7] = q2_q3 + q1_q0;
-            R[8] = 1 - sq_q1 - sq_q2;
-        } else if (sizeR == 16) {
-            R[0] = 1 - sq_q2 - sq_q3;
-            R[1] = q1_q2 - q3_q0;
-            R[2] = q1_q3 + q2_q0;
-            R[3] = 0.0f;
-
-            R[4] = q1_q2 + q3_q0;
-            R[5] = 1 - sq_q1 - sq_q3;
-            R[6] = q2_q3 - q1_q0;
-            R[7] = 0.0f;
-
-            R[8] = q1_q3 - q2_q0;
-            R[9] = q2_q3 + q1_q0;
-            R[10] = 1 - sq_q1 - sq_q2;
-            R[11] = 0.0f;
-
-            R[12] = R[13] = R[14] = 0.0f;
-            R[15] = 1.0f;
-        }
-}
-
-// Sensor Manager getRotationMatrix func
-
-bool sensorManager_getRotationMatrix(float R[],int sizeR, float I[],int sizeI,
-                                        float gravity[], float geomagnetic[]) {
-
-    float Ax = gravity[0];
-    float Ay = gravity[1];
-    float Az = gravity[2];
-    const float Ex = geomagnetic[0];
-    const float Ey = geomagnetic[1];
-    const float Ez = geomagnetic[2];
-    float Hx = Ey*Az - Ez*Ay;
-    float Hy = Ez*Ax - Ex*Az;
-    float Hz = Ex*Ay - Ey*Ax;
-    const float normH = sqrtf(Hx*Hx + Hy*Hy + Hz*Hz);
-    if (normH < 0.1f) {
-        // device is close to free fall (or in space?), or close to
-        // magnetic north pole. Typical values are  > 100.
-        return false;
-    }
-    const float invH = 1.0f / normH;
-    Hx *= invH;
-    Hy *= invH;
-    Hz *= invH;
-    const float invA = 1.0f / sqrtf(Ax*Ax + Ay*Ay + Az*Az);
-    Ax *= invA;
-    Ay *= invA;
-    Az *= invA;
-    const float Mx = Ay*Hz - Az*Hy;
-    const float My = Az*Hx - Ax*Hz;
-    const float Mz = Ax*Hy - Ay*Hx;
-    if (R != NULL) {
-        if (sizeR == 9) {
-            R[0] = Hx;     R[1] = Hy;     R[2] = Hz;
-            R[3] = Mx;     R[4] = My;     R[5] = Mz;
-            R[6] = Ax;     R[7] = Ay;     R[8] = Az;
-        } else if (sizeR == 16) {
-            R[0]  = Hx;    R[1]  = Hy;    R[2]  = Hz;   R[3]  = 0;
-            R[4]  = Mx;    R[5]  = My;    R[6]  = Mz;   R[7]  = 0;
-            R[8]  = Ax;    R[9]  = Ay;    R[10] = Az;   R[11] = 0;
-            R[12] = 0;     R[13] = 0;     R[14] = 0;    R[15] = 1;
-        }
-    }
-    if (I != NULL) {
-        // compute the inclination matrix by projecting the geomagnetic
-        // vector onto the Z (gravity) and X (horizontal component
-        // of geomagnetic vector) axes.
-        const float invE = 1.0f / sqrtf(Ex*Ex + Ey*Ey + Ez*Ez);
-        const float c = (Ex*Mx + Ey*My + Ez*Mz) * invE;
-        const float s = (Ex*Ax + Ey*Ay + Ez*Az) * invE;
-        if (sizeI == 9) {
-            I[0] = 1;     I[1] = 0;     I[2] = 0;
-            I[3] = 0;     I[4] = c;     I[5] = s;
-            I[6] = 0;     I[7] =-s;     I[8] = c;
-        } else if (sizeI == 16) {
-            I[0] = 1;     I[1] = 0;     I[2] = 0;
-            I[4] = 0;     I[5] = c;     I[6] = s;
-            I[8] = 0;     I[9] =-s;     I[10]= c;
-            I[3] = I[7] = I[11] = I[12] = I[13] = I[14] = 0;
-            I[15] = 1;
-        }
-    }
-    return true;
-}
-
-//END_INCLUDE(all)
@@ -0,0 +1,531 @@
+//
+// Sensor fusion of gyro, accelerometer and magnetometer with a
+// complementary filter.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "sensorfusion.h"
+
+#define EPSILON 0.000000001f
+#define NS2S 1.0f / 1000000000.0f
+#define TIME_CONSTANT 30
+// gyro intervals longer than this are integrated in several steps
+#define GYRO_MAX_STEP_NS 20000000LL
+// gaps longer than this are not bridged, the gyro restarts from acc/mag
+#define GYRO_RESET_GAP_NS 500000000LL
+
+//////!!!! BURADAN SONRASI GYRO JITTER EFEKTI DUZELTMEKE ICIN GEREKLI FONKLAR ICIN ///////////
+
+// This function is borrowed from the Android reference
+// at http://developer.android.com/reference/android/hardware/SensorEvent.html#values
+// It calculates a rotation vector from the gyroscope angular speed values.
+
+void getRotationVectorFromGyro(float gyroValues[],
+                               float deltaRotationVector[],
+                               float timeFactor) {
+        float normValues[3] = {0.0f, 0.0f, 0.0f};
+
+        // Calculate the angular speed of the sample
+        float omegaMagnitude = sqrtf(gyroValues[0] * gyroValues[0] +
+                                     gyroValues[1] * gyroValues[1] +
+                                     gyroValues[2] * gyroValues[2]);
+        // Normalize the rotation vector if it's big enough to get the axis
+        if(omegaMagnitude > EPSILON){
+            normValues[0] = gyroValues[0] / omegaMagnitude;
+            normValues[1] = gyroValues[1] / omegaMagnitude;
+            normValues[2] = gyroValues[2] / omegaMagnitude;
+        }
+        // Integrate around this axis with the angular speed by the timestep
+        // in order to get a delta rotation from this sample over the timestep
+        // We will convert this axis-angle representation of the delta rotation
+        // into a quaternion before turning it into the rotation matrix.
+        float thetaOverTwo = omegaMagnitude * timeFactor;
+        float sinThetaOverTwo = sinf(thetaOverTwo);
+        float cosThetaOverTwo = cosf(thetaOverTwo);
+
+        deltaRotationVector[0] = sinThetaOverTwo * normValues[0];
+        deltaRotationVector[1] = sinThetaOverTwo * normValues[1];
+        deltaRotationVector[2] = sinThetaOverTwo * normValues[2];
+        deltaRotationVector[3] = cosThetaOverTwo;
+
+}
+
+/*
+ * gyroFunction
+ *
+ *  integrates the gyro sample into the gyro orientation
+ *
+ * INPUT:
+ *  timestamp: sample time (ns)
+ *  values: angular speed (rad/s)
+ *
+ * OUTPUT:
+ *  true if an interval was integrated, false if the sample only armed the
+ *  integration, was dropped or came before the first acc/mag orientation
+ *  of a cold start. gyroOrientation is valid once the integration is armed.
+ * */
+bool gyroFunction(struct fusion_context* ctx,int64_t timestamp,const float values[]) {
+    // initialisation of the gyroscope based rotation matrix
+    if(ctx->initState) {
+            // on a cold start don't start until first accelerometer/magnetometer
+            // orientation has been acquired, seeding from it before would
+            // start the gyro from zeros
+            if(!ctx->accMagOrientationInit)
+                return false;
+
+#ifdef NATIVEGYRO_FIXED_POINT
+            // the gyro state is still the identity, so this is the
+            // acc/mag orientation itself
+            fixedFusion_setOrientation(&ctx->fixed, ctx->accMagOrientation);
+#else
+            float initMatrix[9];
+            getRotationMatrixFromOrientation(ctx->accMagOrientation,initMatrix);
+            float test[3];
+
+            sensorManager_getOrientation(initMatrix,9, test);
+
+            matrixMultiplication(ctx->gyroMatrix, initMatrix,ctx->gyroMatrix);
+
+//            LOGI("initgyroMatrix: d0=%f d1=%f d2=%f d3=%f d4=%f d5=%f d6=%f d7=%f d8=%f",
+//             ctx->gyroMatrix[0],ctx->gyroMatrix[1],ctx->gyroMatrix[2],
+//             ctx->gyroMatrix[3],ctx->gyroMatrix[4],ctx->gyroMatrix[5],
+//             ctx->gyroMatrix[6],ctx->gyroMatrix[7],ctx->gyroMatrix[8]);
+#endif
+
+            ctx->initState = 0;
+        }
+
+            // the first sample only starts the integration, there is no
+            // interval to integrate yet
+            if(ctx->timestamp == 0) {
+                ctx->timestamp = timestamp;
+                ctx->gyro[0] = values[0];
+                ctx->gyro[1] = values[1];
+                ctx->gyro[2] = values[2];
+                // nothing to fuse yet, but gyroOrientation has to show the
+                // initialised orientation rather than zeros
+#ifdef NATIVEGYRO_FIXED_POINT
+                fixedFusion_getOrientation(&ctx->fixed, ctx->gyroOrientation);
+#else
+                sensorManager_getOrientation(ctx->gyroMatrix,9,ctx->gyroOrientation);
+#endif
+                return false;
+            }
+
+            const int64_t dTns = timestamp - ctx->timestamp;
+
+            // the state is already past this sample, drop it
+            if(dTns <= 0) {
+                if(dTns == 0)
+                    ctx->metrics.duplicates++;
+                else
+                    ctx->metrics.outOfOrder++;
+                return false;
+            }
+
+            float rate[3];
+            rate[0] = values[0];
+            rate[1] = values[1];
+            rate[2] = values[2];
+
+            if(dTns > GYRO_RESET_GAP_NS) {
+                // too long to bridge (suspend, sensor restart), start over
+                // from the acc/mag orientation instead of guessing the motion.
+                // Without one the gap is skipped and the orientation kept.
+                if(ctx->accMagOrientationInit) {
+#ifdef NATIVEGYRO_FIXED_POINT
+                    fixedFusion_setOrientation(&ctx->fixed, ctx->accMagOrientation);
+#else
+                    getRotationMatrixFromOrientation(ctx->accMagOrientation,ctx->gyroMatrix);
+#endif
+                    ctx->metrics.resets++;
+                } else {
+                    ctx->metrics.skippedGaps++;
+                }
+            } else if(dTns > GYRO_MAX_STEP_NS) {
+                // dropped samples, bridge the gap in bounded steps with the
+                // rate interpolated between the samples around it
+                const int steps = (int) ((dTns + GYRO_MAX_STEP_NS - 1) / GYRO_MAX_STEP_NS);
+                const float dT = dTns * NS2S / steps;
+                for(int i = 0; i < steps; i++) {
+                    const float t = (i + 0.5f) / steps;
+                    float stepRate[3];
+                    stepRate[0] = ctx->gyro[0] + (rate[0] - ctx->gyro[0]) * t;
+                    stepRate[1] = ctx->gyro[1] + (rate[1] - ctx->gyro[1]) * t;
+                    stepRate[2] = ctx->gyro[2] + (rate[2] - ctx->gyro[2]) * t;
+                    integrateGyroStep(ctx, stepRate, dT);
+                }
+                ctx->metrics.substepped++;
+                ctx->metrics.substeps += steps;
+            } else {
+                integrateGyroStep(ctx, rate, dTns * NS2S);
+            }
+
+            // measurement done, save current rate and time for next interval
+            memcpy(ctx->gyro, rate, sizeof(rate));
+            ctx->timestamp = timestamp;
+
+            // get the gyroscope based orientation from the rotation matrix
+            //SensorManager.getOrientation(ctx->gyroMatrix, gyroOrientation);
+#ifdef NATIVEGYRO_FIXED_POINT
+            fixedFusion_getOrientation(&ctx->fixed, ctx->gyroOrientation);
+#else
+            sensorManager_getOrientation(ctx->gyroMatrix,9,ctx->gyroOrientation);
+#endif
+            return true;
+        }
+
+/*
+ *  integrateGyroStep
+ *
+ *  applies the rotation of one integration step on gyroMatrix
+ *
+ *  INPUT:
+ *   ctx: fusion context that contains gyroMatrix
+ *   rate: angular speed over the step (rad/s)
+ *   dT: step length (s)
+ * */
+void integrateGyroStep(struct fusion_context* ctx, float rate[], float dT) {
+#ifdef NATIVEGYRO_FIXED_POINT
+            fixedFusion_integrate(&ctx->fixed, rate, dT);
+#else
+            // convert the raw gyro data into a rotation vector
+            float deltaVector[4];
+            getRotationVectorFromGyro(rate, deltaVector, dT / 2.0f);
+
+            // convert rotation vector into rotation matrix
+            float deltaMatrix[9];
+
+            sensorManager_getRotationMatrixFromVector(deltaMatrix,9,deltaVector,4);
+
+//          LOGI("deltaMatrix: d0=%f d1=%f d2=%f d3=%f d4=%f d5=%f d6=%f d7=%f d8=%f",
+//          deltaMatrix[0],deltaMatrix[1],deltaMatrix[2],deltaMatrix[3],deltaMatrix[4],
+//          deltaMatrix[5],deltaMatrix[6],deltaMatrix[7],deltaMatrix[8]);
+
+            // apply the new rotation interval on the gyroscope based rotation matrix
+            matrixMultiplication(ctx->gyroMatrix, deltaMatrix,ctx->gyroMatrix);
+           /* LOGI("gyroMatrix: d0=%f d1=%f d2=%f d3=%f d4=%f d5=%f d6=%f d7=%f d8=%f",
+                 ctx->gyroMatrix[0],ctx->gyroMatrix[1],ctx->gyroMatrix[2],
+                 ctx->gyroMatrix[3],ctx->gyroMatrix[4],ctx->gyroMatrix[5],
+                 ctx->gyroMatrix[6],ctx->gyroMatrix[7],ctx->gyroMatrix[8]);*/
+#endif
+}
+
+
+void getRotationMatrixFromOrientation(float o[],float resultMat[]) {
+        float xM[9];
+        float yM[9];
+        float zM[9];
+
+        float sinX = sinf(o[1]);
+        float cosX = cosf(o[1]);
+        float sinY = sinf(o[2]);
+        float cosY = cosf(o[2]);
+        float sinZ = sinf(o[0]);
+        float cosZ = cosf(o[0]);
+
+        // rotation about x-axis (pitch)
+        xM[0] = 1.0f; xM[1] = 0.0f; xM[2] = 0.0f;
+        xM[3] = 0.0f; xM[4] = cosX; xM[5] = sinX;
+        xM[6] = 0.0f; xM[7] = -sinX; xM[8] = cosX;
+
+        // rotation about y-axis (roll)
+        yM[0] = cosY; yM[1] = 0.0f; yM[2] = sinY;
+        yM[3] = 0.0f; yM[4] = 1.0f; yM[5] = 0.0f;
+        yM[6] = -sinY; yM[7] = 0.0f; yM[8] = cosY;
+
+        // rotation about z-axis (azimuth)
+        zM[0] = cosZ; zM[1] = sinZ; zM[2] = 0.0f;
+        zM[3] = -sinZ; zM[4] = cosZ; zM[5] = 0.0f;
+        zM[6] = 0.0f; zM[7] = 0.0f; zM[8] = 1.0f;
+
+        // rotation order is y, x, z (roll, pitch, azimuth)
+        float resultMatrix[9];
+        matrixMultiplication(xM, yM,resultMatrix);
+        matrixMultiplication(zM, resultMatrix,resultMatrix);
+        memcpy(resultMat,resultMatrix, sizeof(resultMatrix));
+
+    }
+
+/*
+ *  matrixMultiplication
+ *
+ *  it does multiplication for 3x3 matricies
+ *
+ *  INPUT:
+ *   A: 3x3 matrix for first operand
+ *   B: 3x3 matrix for second operand
+ *
+ *   OUTPUT:
+ *   res: 3x3 matrix result of mulptiplication
+ * */
+void matrixMultiplication(float A[], float B[], float res[]) {
+        float result[9];
+
+        result[0] = A[0] * B[0] + A[1] * B[3] + A[2] * B[6];
+        result[1] = A[0] * B[1] + A[1] * B[4] + A[2] * B[7];
+        result[2] = A[0] * B[2] + A[1] * B[5] + A[2] * B[8];
+
+        result[3] = A[3] * B[0] + A[4] * B[3] + A[5] * B[6];
+        result[4] = A[3] * B[1] + A[4] * B[4] + A[5] * B[7];
+        result[5] = A[3] * B[2] + A[4] * B[5] + A[5] * B[8];
+
+        result[6] = A[6] * B[0] + A[7] * B[3] + A[8] * B[6];
+        result[7] = A[6] * B[1] + A[7] * B[4] + A[8] * B[7];
+        result[8] = A[6] * B[2] + A[7] * B[5] + A[8] * B[8];
+
+        memcpy(res,result,sizeof(result));
+
+    }
+
+//accelerometer
+/*
+ * calculateAccMagOrientation
+ *
+ *  calculates orientation from rotation matrix that calculated with Accelerometer and magnatic field vectors
+ *
+ * INPUT:
+ *  ctx: fusion context that contains accel and mag. field vectors
+ *
+ * */
+void calculateAccMagOrientation(struct fusion_context* ctx) {
+
+    if(sensorManager_getRotationMatrix(ctx->rotationMatrix,9, NULL ,0, ctx->accel,ctx->magnet)) {
+            sensorManager_getOrientation(ctx->rotationMatrix,9,ctx->accMagOrientation);
+            if(!ctx->accMagOrientationInit)
+                ctx->accMagOrientationInit=1;
+	    }
+
+}
+
+/*
+ * calculateFusedOrientation
+ *
+ *  makes calculate for fix jitter effect.
+ *
+ * INPUT:
+ *  ctx: fusion context that contains gyroMatrix, gyroOrientation
+ *
+ * */
+
+void calculateFusedOrientation(struct fusion_context* ctx){
+#ifdef NATIVEGYRO_FIXED_POINT
+    // same filter and +-180 degree handling in Q29, the quaternion is
+    // reset to the fused orientation as well
+    fixedFusion_blend(&ctx->fixed, ctx->accMagOrientation, FILTER_COEFFICIENT,
+                      ctx->fusedOrientation);
+#else
+    float oneMinusCoeff = 1.0f - FILTER_COEFFICIENT;
+
+    /*
+     * Fix for 179° <--> -179° transition problem:
+     * Check whether one of the two orientation angles (gyro or accMag) is negative while the other one is positive.
+     * If so, add 360° (2 * math.PI) to the negative value, perform the sensor fusion, and remove the 360° from the result
+     * if it is greater than 180°. This stabilizes the output in positive-to-negative-transition cases.
+     */
+
+    // azimuth
+    if (ctx->gyroOrientation[0] < -0.5 * M_PI && ctx->accMagOrientation[0] > 0.0) {
+        ctx->fusedOrientation[0] = (float) (FILTER_COEFFICIENT * (ctx->gyroOrientation[0] + 2.0 * M_PI) + oneMinusCoeff * ctx->accMagOrientation[0]);
+        ctx->fusedOrientation[0] -= (ctx->fusedOrientation[0] > M_PI) ? 2.0 * M_PI : 0;
+    }
+    else if (ctx->accMagOrientation[0] < -0.5 * M_PI && ctx->gyroOrientation[0] > 0.0) {
+        ctx->fusedOrientation[0] = (float) (FILTER_COEFFICIENT * ctx->gyroOrientation[0] + oneMinusCoeff * (ctx->accMagOrientation[0] + 2.0 * M_PI));
+        ctx->fusedOrientation[0] -= (ctx->fusedOrientation[0] > M_PI)? 2.0 * M_PI : 0;
+    }
+    else {
+        ctx->fusedOrientation[0] = FILTER_COEFFICIENT * ctx->gyroOrientation[0] + oneMinusCoeff * ctx->accMagOrientation[0];
+    }
+
+    // pitch
+    if (ctx->gyroOrientation[1] < -0.5 * M_PI && ctx->accMagOrientation[1] > 0.0) {
+        ctx->fusedOrientation[1] = (float) (FILTER_COEFFICIENT * (ctx->gyroOrientation[1] + 2.0 * M_PI) + oneMinusCoeff * ctx->accMagOrientation[1]);
+        ctx->fusedOrientation[1] -= (ctx->fusedOrientation[1] > M_PI) ? 2.0 * M_PI : 0;
+    }
+    else if (ctx->accMagOrientation[1] < -0.5 * M_PI && ctx->gyroOrientation[1] > 0.0) {
+        ctx->fusedOrientation[1] = (float) (FILTER_COEFFICIENT * ctx->gyroOrientation[1] + oneMinusCoeff * (ctx->accMagOrientation[1] + 2.0 * M_PI));
+        ctx->fusedOrientation[1] -= (ctx->fusedOrientation[1] > M_PI)? 2.0 * M_PI : 0;
+    }
+    else {
+        ctx->fusedOrientation[1] = FILTER_COEFFICIENT * ctx->gyroOrientation[1] + oneMinusCoeff * ctx->accMagOrientation[1];
+    }
+
+    // roll
+    if (ctx->gyroOrientation[2] < -0.5 * M_PI && ctx->accMagOrientation[2] > 0.0) {
+        ctx->fusedOrientation[2] = (float) (FILTER_COEFFICIENT * (ctx->gyroOrientation[2] + 2.0 * M_PI) + oneMinusCoeff * ctx->accMagOrientation[2]);
+        ctx->fusedOrientation[2] -= (ctx->fusedOrientation[2] > M_PI) ? 2.0 * M_PI : 0;
+    }
+    else if (ctx->accMagOrientation[2] < -0.5 * M_PI && ctx->gyroOrientation[2] > 0.0) {
+        ctx->fusedOrientation[2] = (float) (FILTER_COEFFICIENT * ctx->gyroOrientation[2] + oneMinusCoeff * (ctx->accMagOrientation[2] + 2.0 * M_PI));
+        ctx->fusedOrientation[2] -= (ctx->fusedOrientation[2] > M_PI)? 2.0 * M_PI : 0;
+    }
+    else {
+        ctx->fusedOrientation[2] = FILTER_COEFFICIENT * ctx->gyroOrientation[2] + oneMinusCoeff * ctx->accMagOrientation[2];
+    }
+
+    // overwrite gyro matrix and orientation with fused orientation
+    // to comensate gyro drift
+    //gyroMatrix = getRotationMatrixFromOrientation(fusedOrientation);
+    getRotationMatrixFromOrientation(ctx->fusedOrientation,ctx->gyroMatrix);
+#endif
+    //System.arraycopy(fusedOrientation, 0, gyroOrientation, 0, 3);
+    memcpy(ctx->gyroOrientation,ctx->fusedOrientation,sizeof(ctx->fusedOrientation));
+
+}
+
+
+
+// Sensor Manager Functions that not avaible in sensor.h in NDK
+
+// SensorManager getorientation func
+
+void sensorManager_getOrientation(float R[],int sizeR,float values[]){
+
+    /*
+        * 4x4 (length=16) case:
+        *   /  R[ 0]   R[ 1]   R[ 2]   0  \
+        *   |  R[ 4]   R[ 5]   R[ 6]   0  |
+        *   |  R[ 8]   R[ 9]   R[10]   0  |
+        *   \      0       0       0   1  /
+        *
+        * 3x3 (length=9) case:
+        *   /  R[ 0]   R[ 1]   R[ 2]  \
+        *   |  R[ 3]   R[ 4]   R[ 5]  |
+        *   \  R[ 6]   R[ 7]   R[ 8]  /
+        *
+        */
+        if (sizeR == 9) {
+            values[0] = atan2f(R[1], R[4]);
+            values[1] = asinf(-R[7]);
+            values[2] = atan2f(-R[6], R[8]);
+        } else {
+            values[0] = atan2f(R[1], R[5]);
+            values[1] = asinf(-R[9]);
+            values[2] = atan2f(-R[8], R[10]);
+        }
+}
+
+void sensorManager_getRotationMatrixFromVector(float R[],int sizeR, float rotationVector[],int sizeRV) {
+            float q0;
+            float q1 = rotationVector[0];
+            float q2 = rotationVector[1];
+            float q3 = rotationVector[2];
+
+         if (sizeRV == 4) {
+                  q0 = rotationVector[3];
+         } else {
+               q0 = 1 - q1*q1 - q2*q2 - q3*q3;
+                q0 = (q0 > 0) ? sqrtf(q0) : 0;
+         }
+
+        float sq_q1 = 2 * q1 * q1;
+        float sq_q2 = 2 * q2 * q2;
+        float sq_q3 = 2 * q3 * q3;
+        float q1_q2 = 2 * q1 * q2;
+        float q3_q0 = 2 * q3 * q0;
+        float q1_q3 = 2 * q1 * q3;
+        float q2_q0 = 2 * q2 * q0;
+        float q2_q3 = 2 * q2 * q3;
+        float q1_q0 = 2 * q1 * q0;
+
+        if(sizeR == 9) {
+            R[0] = 1 - sq_q2 - sq_q3;
+            R[1] = q1_q2 - q3_q0;
+            R[2] = q1_q3 + q2_q0;
+
+            R[3] = q1_q2 + q3_q0;
+            R[4] = 1 - sq_q1 - sq_q3;
+            R[5] = q2_q3 - q1_q0;
+
+            R[6] = q1_q3 - q2_q0;
+            R[7] = q2_q3 + q1_q0;
+            R[8] = 1 - sq_q1 - sq_q2;
+        } else if (sizeR == 16) {
+            R[0] = 1 - sq_q2 - sq_q3;
+            R[1] = q1_q2 - q3_q0;
+            R[2] = q1_q3 + q2_q0;
+            R[3] = 0.0f;
+
+            R[4] = q1_q2 + q3_q0;
+            R[5] = 1 - sq_q1 - sq_q3;
+            R[6] = q2_q3 - q1_q0;
+            R[7] = 0.0f;
+
+            R[8] = q1_q3 - q2_q0;
+            R[9] = q2_q3 + q1_q0;
+            R[10] = 1 - sq_q1 - sq_q2;
+            R[11] = 0.0f;
+
+            R[12] = R[13] = R[14] = 0.0f;
+            R[15] = 1.0f;
+        }
+}
+
+// Sensor Manager getRotationMatrix func
+
+bool sensorManager_getRotationMatrix(float R[],int sizeR, float I[],int sizeI,
+                                        float gravity[], float geomagnetic[]) {
+
+    float Ax = gravity[0];
+    float Ay = gravity[1];
+    float Az = gravity[2];
+    const float Ex = geomagnetic[0];
+    const float Ey = geomagnetic[1];
+    const float Ez = geomagnetic[2];
+    float Hx = Ey*Az - Ez*Ay;
+    float Hy = Ez*Ax - Ex*Az;
+    float Hz = Ex*Ay - Ey*Ax;
+    const float normH = sqrtf(Hx*Hx + Hy*Hy + Hz*Hz);
+    if (normH < 0.1f) {
+        // device is close to free fall (or in space?), or close to
+        // magnetic north pole. Typical values are  > 100.
+        return false;
+    }
+    const float invH = 1.0f / normH;
+    Hx *= invH;
+    Hy *= invH;
+    Hz *= invH;
+    const float invA = 1.0f / sqrtf(Ax*Ax + Ay*Ay + Az*Az);
+    Ax *= invA;
+    Ay *= invA;
+    Az *= invA;
+    const float Mx = Ay*Hz - Az*Hy;
+    const float My = Az*Hx - Ax*Hz;
+    const float Mz = Ax*Hy - Ay*Hx;
+    if (R != NULL) {
+        if (sizeR == 9) {
+            R[0] = Hx;     R[1] = Hy;     R[2] = Hz;
+            R[3] = Mx;     R[4] = My;     R[5] = Mz;
+            R[6] = Ax;     R[7] = Ay;     R[8] = Az;
+        } else if (sizeR == 16) {
+            R[0]  = Hx;    R[1]  = Hy;    R[2]  = Hz;   R[3]  = 0;
+            R[4]  = Mx;    R[5]  = My;    R[6]  = Mz;   R[7]  = 0;
+            R[8]  = Ax;    R[9]  = Ay;    R[10] = Az;   R[11] = 0;
+            R[12] = 0;     R[13] = 0;     R[14] = 0;    R[15] = 1;
+        }
+    }
+    if (I != NULL) {
+        // compute the inclination matrix by projecting the geomagnetic
+        // vector onto the Z (gravity) and X (horizontal component
+        // of geomagnetic vector) axes.
+        const float invE = 1.0f / sqrtf(Ex*Ex + Ey*Ey + Ez*Ez);
+        const float c = (Ex*Mx + Ey*My + Ez*Mz) * invE;
+        const float s = (Ex*Ax + Ey*Ay + Ez*Az) * invE;
+        if (sizeI == 9) {
+            I[0] = 1;     I[1] = 0;     I[2] = 0;
+            I[3] = 0;     I[4] = c;     I[5] = s;
+            I[6] = 0;     I[7] =-s;     I[8] = c;
+        } else if (sizeI == 16) {
+            I[0] = 1;     I[1] = 0;     I[2] = 0;
+            I[4] = 0;     I[5] = c;     I[6] = s;
+            I[8] = 0;     I[9] =-s;     I[10]= c;
+            I[3] = I[7] = I[11] = I[12] = I[13] = I[14] = 0;
+            I[15] = 1;
+        }
+    }
+    return true;
+}
+
+//END_INCLUDE(all)
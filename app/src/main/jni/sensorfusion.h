@@ -0,0 +1,94 @@
+//
+// Sensor fusion of gyro, accelerometer and magnetometer with a
+// complementary filter. Split from nativegyro.cpp so the fusion builds
+// without the app glue, see tools/fusionbench.
+//
+
+#ifndef NATIVEGYRO_SENSORFUSION_H
+#define NATIVEGYRO_SENSORFUSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef NATIVEGYRO_FIXED_POINT
+#include "fixedfusion.h"
+#endif
+
+#define FILTER_COEFFICIENT 0.98f
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Counters of the gyro samples that could not be integrated normally.
+ */
+struct gyro_metrics {
+    uint32_t duplicates;
+    uint32_t outOfOrder;
+    // intervals split into substeps, and the substeps used for them
+    uint32_t substepped;
+    uint32_t substeps;
+    // gaps restarted from acc/mag, and gaps skipped without an acc/mag
+    // orientation to restart from
+    uint32_t resets;
+    uint32_t skippedGaps;
+};
+
+/**
+ * Per-sample sensor fusion state.
+ *
+ * Everything the sensor callbacks touch is kept here, apart from the cold
+ * engine state, and the fields are ordered by the sequence in which they
+ * are accessed:
+ *   line 0: gyroFunction
+ *   line 1: calculateFusedOrientation and the acc/mag inputs (60 bytes)
+ *   line 2: calculateAccMagOrientation, gap metrics (only touched on gaps)
+ * A gyro sample touches two cache lines, and contexts can be packed into
+ * arrays for multi-stream processing without sharing lines.
+ */
+struct fusion_context {
+    int64_t timestamp;
+    int32_t initState;
+    int32_t accMagOrientationInit;
+    // angular speeds from gyro
+    float gyro[3];
+#ifdef NATIVEGYRO_FIXED_POINT
+    // gyro orientation as a fixed-point quaternion, same size as gyroMatrix
+    struct fixed_fusion fixed;
+#else
+    // rotation matrix from gyro data
+    float gyroMatrix[9];
+#endif
+
+    float gyroOrientation[3];
+    float accMagOrientation[3];
+    // final orientation angles from sensor fusion
+    float fusedOrientation[3];
+    // accelerometer vector
+    float accel[3];
+    // magnetic field vector, hard/soft-iron corrected
+    float magnet[3];
+
+    // accelerometer and magnetometer based rotation matrix, starts line 2
+    float rotationMatrix[9] __attribute__((aligned(CACHE_LINE_SIZE)));
+    struct gyro_metrics metrics;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// the gyro integration state has to fill exactly the first line
+typedef char fusion_context_line_check[
+        offsetof(struct fusion_context, gyroOrientation) == CACHE_LINE_SIZE ? 1 : -1];
+typedef char fusion_context_line2_check[
+        offsetof(struct fusion_context, rotationMatrix) == 2 * CACHE_LINE_SIZE ? 1 : -1];
+
+/*Func. Prototypes*/
+
+void matrixMultiplication(float A[], float B[], float res[]);
+void getRotationMatrixFromOrientation(float o[],float resultMat[]);
+void sensorManager_getOrientation(float R[],int sizeR,float values[]);
+void sensorManager_getRotationMatrixFromVector(float R[],int sizeR, float rotationVector[],int sizeRV);
+bool sensorManager_getRotationMatrix(float R[],int sizeR, float I[],int sizeI,
+                                     float gravity[], float geomagnetic[]);
+bool gyroFunction(struct fusion_context* ctx,int64_t timestamp,const float values[]);
+void integrateGyroStep(struct fusion_context* ctx, float rate[], float dT);
+void calculateAccMagOrientation(struct fusion_context* ctx);
+void calculateFusedOrientation(struct fusion_context* ctx);
+
+#endif //NATIVEGYRO_SENSORFUSION_H
@@ -0,0 +1,257 @@
+//
+// Compact trace format for the sensor streams used by the fusion. The
+// decoder is in tracedecoder.cpp.
+//
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracecodec.h"
+
+/*Func. Prototypes*/
+
+static bool writeBlock(struct trace_encoder* enc, int sensor);
+static bool writeAll(struct trace_encoder* enc, const void* data, size_t size);
+static bool fail(struct trace_encoder* enc);
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline uint8_t* putVarint(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t) v;
+    return p;
+}
+
+/*
+ * traceEncoder_open
+ *
+ *  starts a new trace. An existing file is never overwritten, the caller
+ *  picks a new name per session.
+ * */
+bool traceEncoder_open(struct trace_encoder* enc, const char* path) {
+    memset(enc, 0, sizeof(*enc));
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    enc->fp = fdopen(fd, "wb");
+    if (enc->fp == NULL) {
+        close(fd);
+        return false;
+    }
+
+    struct trace_file_header header;
+    header.magic = TRACE_FILE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.reserved = 0;
+    if (!writeAll(enc, &header, sizeof(header))) {
+        fclose(enc->fp);
+        enc->fp = NULL;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * traceEncoder_setResolution
+ *
+ *  sets the smallest quantization step used for a sensor, usually
+ *  ASensor_getResolution(). 0 quantizes to the full int16 range.
+ * */
+void traceEncoder_setResolution(struct trace_encoder* enc, int sensor, float resolution) {
+    if (sensor >= 0 && sensor < TRACE_SENSOR_COUNT && resolution >= 0.0f) {
+        enc->resolution[sensor] = resolution;
+    }
+}
+
+/*
+ * traceEncoder_add
+ *
+ *  buffers one sample, a full buffer is encoded and written as a block
+ *
+ * INPUT:
+ *  enc: encoder
+ *  sensor: TRACE_SENSOR_*
+ *  timestamp: event timestamp (ns)
+ *  x, y, z: event values
+ * */
+bool traceEncoder_add(struct trace_encoder* enc, int sensor, int64_t timestamp,
+                      float x, float y, float z) {
+    if (enc->fp == NULL || enc->error || sensor < 0 || sensor >= TRACE_SENSOR_COUNT ||
+        enc->channel[sensor].count >= TRACE_BLOCK_SAMPLES) {
+        return false;
+    }
+
+    const int i = enc->channel[sensor].count++;
+    enc->channel[sensor].timestamp[i] = timestamp;
+    enc->channel[sensor].v[i][0] = x;
+    enc->channel[sensor].v[i][1] = y;
+    enc->channel[sensor].v[i][2] = z;
+
+    if (enc->channel[sensor].count == TRACE_BLOCK_SAMPLES) {
+        return writeBlock(enc, sensor);
+    }
+    return true;
+}
+
+bool traceEncoder_flush(struct trace_encoder* enc) {
+    if (enc->fp == NULL || enc->error) {
+        return false;
+    }
+    for (int s = 0; s < TRACE_SENSOR_COUNT; s++) {
+        if (enc->channel[s].count > 0 && !writeBlock(enc, s)) {
+            return false;
+        }
+    }
+    return fflush(enc->fp) == 0 || fail(enc);
+}
+
+/*
+ * traceEncoder_close
+ *
+ *  writes the pending blocks, the index and the footer. After an error
+ *  only the file is closed, an index would point at blocks that are
+ *  missing or cut short.
+ * */
+bool traceEncoder_close(struct trace_encoder* enc) {
+    if (enc->fp == NULL) {
+        return false;
+    }
+
+    bool ok = traceEncoder_flush(enc);
+
+    struct trace_footer footer;
+    footer.indexOffset = enc->offset;
+    footer.blockCount = enc->blockCount;
+    footer.magic = TRACE_INDEX_MAGIC;
+
+    ok = ok && writeAll(enc, enc->index, enc->blockCount * sizeof(struct trace_index_entry));
+    ok = ok && writeAll(enc, &footer, sizeof(footer));
+    ok = (fclose(enc->fp) == 0) && ok && !enc->error;
+
+    free(enc->index);
+    enc->index = NULL;
+    enc->fp = NULL;
+    return ok;
+}
+
+static bool writeAll(struct trace_encoder* enc, const void* data, size_t size) {
+    if (size > 0 && fwrite(data, size, 1, enc->fp) != 1) {
+        return fail(enc);
+    }
+    enc->offset += size;
+    return true;
+}
+
+/*
+ * fail
+ *
+ *  marks the encoder as failed and drops the buffered samples. Part of
+ *  the failed write may be in the file already, so offset and the index
+ *  no longer describe the file and nothing else is written.
+ *
+ * OUTPUT:
+ *  false, for use as a return value
+ * */
+static bool fail(struct trace_encoder* enc) {
+    enc->error = 1;
+    for (int s = 0; s < TRACE_SENSOR_COUNT; s++) {
+        enc->channel[s].count = 0;
+    }
+    return false;
+}
+
+/*
+ * writeBlock
+ *
+ *  encodes the buffered samples of one sensor and appends an index entry
+ * */
+static bool writeBlock(struct trace_encoder* enc, int sensor) {
+    const int count = enc->channel[sensor].count;
+    const int64_t* ts = enc->channel[sensor].timestamp;
+    float (*v)[3] = enc->channel[sensor].v;
+
+    struct trace_block_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_BLOCK_MAGIC;
+    header.sensor = (uint8_t) sensor;
+    header.count = (uint16_t) count;
+    header.firstTimestamp = ts[0];
+
+    float invScale[3];
+    for (int a = 0; a < 3; a++) {
+        float maxAbs = 0.0f;
+        for (int i = 0; i < count; i++) {
+            const float m = fabsf(v[i][a]);
+            if (m > maxAbs) maxAbs = m;
+        }
+        header.scale[a] = maxAbs / 32767.0f;
+        if (header.scale[a] < enc->resolution[sensor]) {
+            header.scale[a] = enc->resolution[sensor];
+        }
+        if (!(header.scale[a] > 0.0f)) {
+            header.scale[a] = 1.0f;
+        }
+        invScale[a] = 1.0f / header.scale[a];
+    }
+
+    uint8_t* p = enc->payload;
+    int64_t prevUs = 0;
+    int64_t prevDelta = 0;
+    int32_t prevQ[3] = { 0, 0, 0 };
+    for (int i = 0; i < count; i++) {
+        // us relative to the block start, rounded to nearest
+        const int64_t rel = ts[i] - ts[0];
+        const int64_t us = (rel >= 0 ? rel + 500 : rel - 500) / 1000;
+        if (i > 0) {
+            const int64_t delta = us - prevUs;
+            p = putVarint(p, zigzag(delta - prevDelta));
+            prevDelta = delta;
+        }
+        prevUs = us;
+
+        for (int a = 0; a < 3; a++) {
+            int32_t q = (int32_t) lrintf(v[i][a] * invScale[a]);
+            if (q > 32767) q = 32767;
+            if (q < -32767) q = -32767;
+            p = putVarint(p, zigzag(q - prevQ[a]));
+            prevQ[a] = q;
+        }
+    }
+    header.payloadSize = (uint32_t) (p - enc->payload);
+
+    if (enc->blockCount == enc->indexCapacity) {
+        const uint32_t capacity = enc->indexCapacity ? enc->indexCapacity * 2 : 64;
+        struct trace_index_entry* index = (struct trace_index_entry*)
+                realloc(enc->index, capacity * sizeof(struct trace_index_entry));
+        if (index == NULL) {
+            return fail(enc);
+        }
+        enc->index = index;
+        enc->indexCapacity = capacity;
+    }
+    struct trace_index_entry* entry = &enc->index[enc->blockCount];
+    memset(entry, 0, sizeof(*entry));
+    entry->offset = enc->offset;
+    entry->firstTimestamp = ts[0];
+    entry->lastTimestamp = ts[count - 1];
+    entry->sensor = (uint8_t) sensor;
+    entry->count = (uint16_t) count;
+
+    enc->channel[sensor].count = 0;
+    if (!writeAll(enc, &header, sizeof(header)) ||
+        !writeAll(enc, enc->payload, header.payloadSize)) {
+        return false;
+    }
+    enc->blockCount++;
+    return true;
+}
@@ -0,0 +1,135 @@
+//
+// Compact trace format for the sensor streams used by the fusion.
+//
+// File layout (little endian):
+//   trace_file_header
+//   block*        trace_block_header followed by payloadSize bytes
+//   index         blockCount trace_index_entry
+//   trace_footer
+//
+// Every block holds up to TRACE_BLOCK_SAMPLES samples of one sensor and
+// decodes on its own, so blocks can be decoded in any order and in parallel.
+// Timestamps are stored relative to the block start with 1 us resolution as
+// zigzag varints of the delta-of-delta. Values are quantized to int16 with a
+// per-block, per-axis scale and stored as zigzag varints of the delta to the
+// previous sample. The scale never goes below the sensor resolution, finer
+// steps would only spend bits on the sensor's own quantization noise.
+//
+// A stream without index (encoder killed before close) is still readable,
+// the decoder then finds the blocks by scanning their headers.
+//
+
+#ifndef NATIVEGYRO_TRACECODEC_H
+#define NATIVEGYRO_TRACECODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_FILE_MAGIC 0x5254474e  // "NGTR"
+#define TRACE_BLOCK_MAGIC 0x4254474e // "NGTB"
+#define TRACE_INDEX_MAGIC 0x4954474e // "NGTI"
+#define TRACE_VERSION 1
+
+#define TRACE_BLOCK_SAMPLES 256
+#define TRACE_SENSOR_COUNT 3
+// worst case payload: 10 byte timestamp + 3 values of 3 bytes
+#define TRACE_MAX_PAYLOAD (TRACE_BLOCK_SAMPLES * 19)
+
+enum {
+    TRACE_SENSOR_ACCEL = 0,
+    TRACE_SENSOR_GYRO = 1,
+    TRACE_SENSOR_MAG = 2
+};
+
+struct trace_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct trace_block_header {
+    uint32_t magic;
+    uint8_t sensor;
+    uint8_t reserved;
+    uint16_t count;
+    int64_t firstTimestamp;
+    float scale[3];
+    uint32_t payloadSize;
+};
+
+struct trace_index_entry {
+    int64_t offset;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint8_t sensor;
+    uint8_t reserved;
+    uint16_t count;
+    uint32_t reserved2;
+};
+
+struct trace_footer {
+    int64_t indexOffset;
+    uint32_t blockCount;
+    uint32_t magic;
+};
+
+/**
+ * One decoded sample.
+ */
+struct trace_sample {
+    int64_t timestamp;
+    int32_t sensor;
+    float v[3];
+};
+
+/**
+ * Streaming encoder. Samples are buffered per sensor and written one
+ * block at a time, so the cost per sample is a copy into the buffer.
+ *
+ * The first failed write or allocation sets error. The buffered samples
+ * are dropped and nothing is written after that, close then leaves the
+ * file without index so the blocks written before stay readable.
+ */
+struct trace_encoder {
+    FILE* fp;
+    int64_t offset;
+    int error;
+    float resolution[TRACE_SENSOR_COUNT];
+
+    struct {
+        int64_t timestamp[TRACE_BLOCK_SAMPLES];
+        float v[TRACE_BLOCK_SAMPLES][3];
+        int count;
+    } channel[TRACE_SENSOR_COUNT];
+
+    struct trace_index_entry* index;
+    uint32_t blockCount;
+    uint32_t indexCapacity;
+
+    uint8_t payload[TRACE_MAX_PAYLOAD];
+};
+
+/**
+ * Decoder over a trace held in memory.
+ */
+struct trace_decoder {
+    const uint8_t* data;
+    size_t size;
+    struct trace_index_entry* index;
+    uint32_t blockCount;
+};
+
+bool traceEncoder_open(struct trace_encoder* enc, const char* path);
+void traceEncoder_setResolution(struct trace_encoder* enc, int sensor, float resolution);
+bool traceEncoder_add(struct trace_encoder* enc, int sensor, int64_t timestamp,
+                      float x, float y, float z);
+bool traceEncoder_flush(struct trace_encoder* enc);
+bool traceEncoder_close(struct trace_encoder* enc);
+
+bool traceDecoder_open(struct trace_decoder* dec, const uint8_t* data, size_t size);
+int traceDecoder_decodeBlock(const struct trace_decoder* dec, uint32_t block,
+                             struct trace_sample out[]);
+void traceDecoder_close(struct trace_decoder* dec);
+
+#endif //NATIVEGYRO_TRACECODEC_H
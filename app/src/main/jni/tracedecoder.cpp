@@ -0,0 +1,166 @@
+//
+// Decoder of the sensor trace format, see tracecodec.h. Host side only,
+// it is not part of the device library.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracecodec.h"
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+// returns NULL on a truncated or overlong varint
+static inline const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t b = *p++;
+        result |= (uint64_t) (b & 0x7f) << shift;
+        if (b < 0x80) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * traceDecoder_open
+ *
+ *  reads the index of a trace in memory. Without a valid footer the blocks
+ *  are found by walking the block headers from the start.
+ *
+ * INPUT:
+ *  data: trace bytes, must outlive the decoder
+ *  size: size of data
+ * */
+bool traceDecoder_open(struct trace_decoder* dec, const uint8_t* data, size_t size) {
+    memset(dec, 0, sizeof(*dec));
+    dec->data = data;
+    dec->size = size;
+
+    struct trace_file_header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != TRACE_FILE_MAGIC || header.version != TRACE_VERSION) {
+        return false;
+    }
+
+    struct trace_footer footer;
+    if (size >= sizeof(header) + sizeof(footer)) {
+        memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+        const uint64_t indexSize = (uint64_t) footer.blockCount * sizeof(struct trace_index_entry);
+        if (footer.magic == TRACE_INDEX_MAGIC && footer.indexOffset >= (int64_t) sizeof(header) &&
+            (uint64_t) footer.indexOffset + indexSize + sizeof(footer) == size) {
+            dec->index = (struct trace_index_entry*) malloc(indexSize ? indexSize : 1);
+            if (dec->index == NULL) {
+                return false;
+            }
+            memcpy(dec->index, data + footer.indexOffset, indexSize);
+            dec->blockCount = footer.blockCount;
+            return true;
+        }
+    }
+
+    // no index, scan the blocks
+    uint32_t capacity = 0;
+    size_t offset = sizeof(header);
+    struct trace_block_header block;
+    while (offset + sizeof(block) <= size) {
+        memcpy(&block, data + offset, sizeof(block));
+        if (block.magic != TRACE_BLOCK_MAGIC || block.count == 0 ||
+            block.count > TRACE_BLOCK_SAMPLES || block.sensor >= TRACE_SENSOR_COUNT ||
+            block.payloadSize > size - offset - sizeof(block)) {
+            break;
+        }
+        if (dec->blockCount == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct trace_index_entry* index = (struct trace_index_entry*)
+                    realloc(dec->index, capacity * sizeof(struct trace_index_entry));
+            if (index == NULL) {
+                traceDecoder_close(dec);
+                return false;
+            }
+            dec->index = index;
+        }
+        struct trace_index_entry* entry = &dec->index[dec->blockCount++];
+        memset(entry, 0, sizeof(*entry));
+        entry->offset = offset;
+        entry->firstTimestamp = block.firstTimestamp;
+        // unknown without decoding the payload
+        entry->lastTimestamp = block.firstTimestamp;
+        entry->sensor = block.sensor;
+        entry->count = block.count;
+
+        offset += sizeof(block) + block.payloadSize;
+    }
+    return true;
+}
+
+/*
+ * traceDecoder_decodeBlock
+ *
+ *  decodes one block. Blocks share no state, this may be called for
+ *  different blocks from different threads.
+ *
+ * INPUT:
+ *  dec: decoder
+ *  block: index of the block
+ *
+ * OUTPUT:
+ *  out: up to TRACE_BLOCK_SAMPLES samples
+ *  returns the number of samples, or -1 if the block is corrupt
+ * */
+int traceDecoder_decodeBlock(const struct trace_decoder* dec, uint32_t block,
+                             struct trace_sample out[]) {
+    if (block >= dec->blockCount) {
+        return -1;
+    }
+    const int64_t offset = dec->index[block].offset;
+
+    struct trace_block_header header;
+    if (offset < 0 || (uint64_t) offset + sizeof(header) > dec->size) {
+        return -1;
+    }
+    memcpy(&header, dec->data + offset, sizeof(header));
+    if (header.magic != TRACE_BLOCK_MAGIC || header.count > TRACE_BLOCK_SAMPLES ||
+        header.payloadSize > dec->size - offset - sizeof(header)) {
+        return -1;
+    }
+
+    const uint8_t* p = dec->data + offset + sizeof(header);
+    const uint8_t* end = p + header.payloadSize;
+    int64_t us = 0;
+    int64_t delta = 0;
+    int32_t q[3] = { 0, 0, 0 };
+    uint64_t raw;
+    for (int i = 0; i < header.count; i++) {
+        if (i > 0) {
+            if ((p = getVarint(p, end, &raw)) == NULL) {
+                return -1;
+            }
+            delta += unzigzag(raw);
+            us += delta;
+        }
+        for (int a = 0; a < 3; a++) {
+            if ((p = getVarint(p, end, &raw)) == NULL) {
+                return -1;
+            }
+            q[a] += (int32_t) unzigzag(raw);
+            out[i].v[a] = q[a] * header.scale[a];
+        }
+        out[i].timestamp = header.firstTimestamp + us * 1000;
+        out[i].sensor = header.sensor;
+    }
+    return header.count;
+}
+
+void traceDecoder_close(struct trace_decoder* dec) {
+    free(dec->index);
+    dec->index = NULL;
+    dec->blockCount = 0;
+}
@@ -0,0 +1,497 @@
+//
+// Host benchmark of the per-sample fusion path over N independent streams.
+//
+//   fusionbench [samples]
+//
+// Every stream runs the engine's sequence: acc/mag orientation on every
+// 4th sample, then gyroFunction and calculateFusedOrientation. The streams
+// are processed round-robin, so with enough of them the state no longer
+// fits in the caches.
+//
+// sensorfusion.cpp is compiled twice, once per layout, so both run the
+// same code:
+//   split:  struct fusion_context array, the layout the app uses now
+//   legacy: the layout before the split, the fields in struct engine in
+//           their old order plus the former globals. The fusion code
+//           reaches them through a context of references built on the
+//           stack per sample, which costs a few L1 hits.
+//
+// Cache misses are read with perf_event_open around each run, "n/a" where
+// the kernel or the machine does not provide the counter. The cache lines
+// a gyro sample touches are counted from the field addresses as well, that
+// number does not need the counters.
+//
+
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef NATIVEGYRO_FIXED_POINT
+#include "fixedfusion.h"
+#endif
+#include "magcalibration.h"
+
+namespace split {
+#include "sensorfusion.cpp"
+}
+
+namespace legacy {
+
+using split::gyro_metrics;
+
+struct saved_state {
+    float angle;
+    int32_t x;
+    int32_t y;
+};
+
+/**
+ * struct engine before the split, the app and EGL handles as plain
+ * pointers. The fixed-point build keeps its quaternion where gyroMatrix
+ * was, it has the same size.
+ */
+struct engine {
+    void* app;
+
+    void* sensorManager;
+    const void* accelerometerSensor;
+    const void* gyroSensor;
+    const void* magSensor;
+    void* sensorEventQueue;
+    void* sensorEventQueueGyro;
+    void* sensorEventQueueMag;
+
+    float gyro[3];
+#ifdef NATIVEGYRO_FIXED_POINT
+    struct fixed_fusion fixed;
+#else
+    float gyroMatrix[9];
+#endif
+    float gyroOrientation[3];
+    float rotationMatrix[9];
+    float magnet[3];
+    struct mag_calibration magCal;
+    float accel[3];
+
+    int64_t startTime;
+    int warmStart;
+    int firstOrientationLogged;
+
+    int animating;
+    void* display;
+    void* surface;
+    void* context;
+    int32_t width;
+    int32_t height;
+    struct saved_state state;
+};
+
+/**
+ * The former globals, one set per stream. The gap metrics did not exist
+ * then, they are only touched on gaps.
+ */
+struct globals {
+    float accMagOrientation[3];
+    bool accMagOrienttationInit;
+    bool initState;
+    int64_t timestamp;
+    float fusedOrientation[3];
+    struct gyro_metrics metrics;
+};
+
+struct fusion_context {
+    int64_t& timestamp;
+    bool& initState;
+    bool& accMagOrientationInit;
+    float (&gyro)[3];
+#ifdef NATIVEGYRO_FIXED_POINT
+    struct fixed_fusion& fixed;
+#else
+    float (&gyroMatrix)[9];
+#endif
+    float (&gyroOrientation)[3];
+    float (&accMagOrientation)[3];
+    float (&fusedOrientation)[3];
+    float (&accel)[3];
+    float (&magnet)[3];
+    float (&rotationMatrix)[9];
+    struct gyro_metrics& metrics;
+
+    fusion_context(struct engine* e, struct globals* g) :
+            timestamp(g->timestamp), initState(g->initState),
+            accMagOrientationInit(g->accMagOrienttationInit), gyro(e->gyro),
+#ifdef NATIVEGYRO_FIXED_POINT
+            fixed(e->fixed),
+#else
+            gyroMatrix(e->gyroMatrix),
+#endif
+            gyroOrientation(e->gyroOrientation), accMagOrientation(g->accMagOrientation),
+            fusedOrientation(g->fusedOrientation), accel(e->accel), magnet(e->magnet),
+            rotationMatrix(e->rotationMatrix), metrics(g->metrics) {
+    }
+};
+
+// sensorfusion.h is already included above, declare its functions for
+// this context type
+void matrixMultiplication(float A[], float B[], float res[]);
+void getRotationMatrixFromOrientation(float o[],float resultMat[]);
+void sensorManager_getOrientation(float R[],int sizeR,float values[]);
+void sensorManager_getRotationMatrixFromVector(float R[],int sizeR, float rotationVector[],int sizeRV);
+bool sensorManager_getRotationMatrix(float R[],int sizeR, float I[],int sizeI,
+                                     float gravity[], float geomagnetic[]);
+bool gyroFunction(struct fusion_context* ctx,int64_t timestamp,const float values[]);
+void integrateGyroStep(struct fusion_context* ctx, float rate[], float dT);
+void calculateAccMagOrientation(struct fusion_context* ctx);
+void calculateFusedOrientation(struct fusion_context* ctx);
+
+#include "sensorfusion.cpp"
+
+}
+
+#define DEFAULT_SAMPLES 4000000
+
+static const int streamCounts[] = { 1, 64, 1024, 16384, 65536 };
+
+/**
+ * Cache miss counters, fd -1 where not available.
+ */
+struct counters {
+    int llc;
+    int l1d;
+};
+
+/**
+ * Result of one run.
+ */
+struct result {
+    double seconds;
+    // -1 if not counted
+    long long llcMisses;
+    long long l1dMisses;
+    // mean cache lines of the fields a gyro sample reads or writes
+    double hotLines;
+};
+
+#define MAX_HOT_LINES 32
+
+/*
+ * addLines
+ *
+ *  adds the cache lines of size bytes at p to lines, each line once
+ * */
+static void addLines(uintptr_t lines[], int* count, const void* p, size_t size) {
+    const uintptr_t first = (uintptr_t) p / CACHE_LINE_SIZE;
+    const uintptr_t last = ((uintptr_t) p + size - 1) / CACHE_LINE_SIZE;
+    for (uintptr_t line = first; line <= last; line++) {
+        int i = 0;
+        while (i < *count && lines[i] != line) {
+            i++;
+        }
+        if (i == *count && *count < MAX_HOT_LINES) {
+            lines[(*count)++] = line;
+        }
+    }
+}
+
+/*
+ * hotLines
+ *
+ *  cache lines of the fields gyroFunction and calculateFusedOrientation
+ *  use for a gyro sample, works on both layouts
+ * */
+template<typename Context>
+static int hotLines(const Context& ctx) {
+    uintptr_t lines[MAX_HOT_LINES];
+    int count = 0;
+    addLines(lines, &count, &ctx.timestamp, sizeof(ctx.timestamp));
+    addLines(lines, &count, &ctx.initState, sizeof(ctx.initState));
+    addLines(lines, &count, &ctx.accMagOrientationInit, sizeof(ctx.accMagOrientationInit));
+    addLines(lines, &count, &ctx.gyro, sizeof(ctx.gyro));
+#ifdef NATIVEGYRO_FIXED_POINT
+    addLines(lines, &count, &ctx.fixed, sizeof(ctx.fixed));
+#else
+    addLines(lines, &count, &ctx.gyroMatrix, sizeof(ctx.gyroMatrix));
+#endif
+    addLines(lines, &count, &ctx.gyroOrientation, sizeof(ctx.gyroOrientation));
+    addLines(lines, &count, &ctx.accMagOrientation, sizeof(ctx.accMagOrientation));
+    addLines(lines, &count, &ctx.fusedOrientation, sizeof(ctx.fusedOrientation));
+    return count;
+}
+
+/*Func. Prototypes*/
+
+static double now();
+static int openCounter(uint32_t type, uint64_t config);
+static void startCounters(const struct counters* c);
+static long long readCounter(int fd);
+static void initInputs(float accel[], float magnet[]);
+static void sampleRate(int s, int64_t* timestamp, float rate[]);
+static struct result runSplit(const struct counters* c, struct split::fusion_context* ctx,
+                              int streams, int steps);
+static struct result runLegacy(const struct counters* c, struct legacy::engine* engines,
+                               struct legacy::globals* globals, int streams, int steps);
+static void keepBest(struct result* best, const struct result* r);
+static void printResult(const char* name, const struct result* r, double n);
+
+int main(int argc, char** argv) {
+    const long samples = argc > 1 ? atol(argv[1]) : DEFAULT_SAMPLES;
+    if (samples <= 0) {
+        fprintf(stderr, "usage: %s [samples]\n", argv[0]);
+        return 2;
+    }
+
+    struct counters c;
+    c.llc = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    c.l1d = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    printf("%s path, split: fusion_context %zu bytes, "
+           "legacy: engine %zu + globals %zu bytes, cache counters %s\n",
+#ifdef NATIVEGYRO_FIXED_POINT
+           "fixed-point",
+#else
+           "float",
+#endif
+           sizeof(struct split::fusion_context), sizeof(struct legacy::engine),
+           sizeof(struct legacy::globals),
+           c.llc >= 0 || c.l1d >= 0 ? "on" : "n/a");
+
+    for (size_t i = 0; i < sizeof(streamCounts) / sizeof(streamCounts[0]); i++) {
+        const int streams = streamCounts[i];
+        const int steps = (int) (samples / streams);
+        if (steps < 8) {
+            continue;
+        }
+
+        struct split::fusion_context* ctx = (struct split::fusion_context*)
+                aligned_alloc(CACHE_LINE_SIZE, streams * sizeof(struct split::fusion_context));
+        struct legacy::engine* engines = (struct legacy::engine*)
+                calloc(streams, sizeof(struct legacy::engine));
+        struct legacy::globals* globals = (struct legacy::globals*)
+                calloc(streams, sizeof(struct legacy::globals));
+        if (ctx == NULL || engines == NULL || globals == NULL) {
+            fprintf(stderr, "out of memory at %d streams\n", streams);
+            return 1;
+        }
+
+        // warm up once, then keep the better of two runs
+        struct result split, legacy;
+        split.seconds = legacy.seconds = 1e30;
+        for (int rep = 0; rep < 2; rep++) {
+            struct result r = runLegacy(&c, engines, globals, streams, steps);
+            keepBest(&legacy, &r);
+            r = runSplit(&c, ctx, streams, steps);
+            keepBest(&split, &r);
+        }
+
+        // both layouts ran the same inputs, the results have to agree
+        float diff = 0.0f;
+        for (int k = 0; k < streams; k++) {
+            diff += fabsf(ctx[k].fusedOrientation[0] - globals[k].fusedOrientation[0]);
+        }
+
+        const double n = (double) steps * streams;
+        printf("streams %6d%s\n", streams, diff != 0.0f ? "  MISMATCH" : "");
+        printResult("legacy", &legacy, n);
+        printResult("split", &split, n);
+        free(ctx);
+        free(engines);
+        free(globals);
+    }
+    return 0;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * openCounter
+ *
+ *  opens a disabled user space counter on this thread
+ *
+ * OUTPUT:
+ *  fd, -1 if the counter is not available
+ * */
+static int openCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void startCounters(const struct counters* c) {
+    if (c->llc >= 0) {
+        ioctl(c->llc, PERF_EVENT_IOC_RESET, 0);
+        ioctl(c->llc, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (c->l1d >= 0) {
+        ioctl(c->l1d, PERF_EVENT_IOC_RESET, 0);
+        ioctl(c->l1d, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/*
+ * readCounter
+ *
+ *  stops the counter and reads it
+ *
+ * OUTPUT:
+ *  count, -1 if the counter is not available
+ * */
+static long long readCounter(int fd) {
+    if (fd < 0) {
+        return -1;
+    }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+    }
+    return count;
+}
+
+static void initInputs(float accel[], float magnet[]) {
+    accel[0] = 0.3f;
+    accel[1] = 0.2f;
+    accel[2] = 9.8f;
+    magnet[0] = 20.0f;
+    magnet[1] = -30.0f;
+    magnet[2] = 25.0f;
+}
+
+// gyro sample s of every stream, 400 Hz
+static void sampleRate(int s, int64_t* timestamp, float rate[]) {
+    *timestamp = 1000000000LL + s * 2500000LL;
+    rate[0] = 0.1f * sinf(s * 0.01f);
+    rate[1] = 0.05f;
+    rate[2] = -0.02f;
+}
+
+static struct result runSplit(const struct counters* c, struct split::fusion_context* ctx,
+                              int streams, int steps) {
+    memset(ctx, 0, streams * sizeof(*ctx));
+    for (int i = 0; i < streams; i++) {
+        ctx[i].initState = 1;
+#ifdef NATIVEGYRO_FIXED_POINT
+        fixedFusion_init(&ctx[i].fixed);
+#else
+        ctx[i].gyroMatrix[0] = 1.0f;
+        ctx[i].gyroMatrix[4] = 1.0f;
+        ctx[i].gyroMatrix[8] = 1.0f;
+#endif
+        initInputs(ctx[i].accel, ctx[i].magnet);
+    }
+
+    struct result r;
+    startCounters(c);
+    const double start = now();
+    for (int s = 0; s < steps; s++) {
+        int64_t timestamp;
+        float rate[3];
+        sampleRate(s, &timestamp, rate);
+        for (int i = 0; i < streams; i++) {
+            if ((s & 3) == 0) {
+                split::calculateAccMagOrientation(&ctx[i]);
+            }
+            if (split::gyroFunction(&ctx[i], timestamp, rate)) {
+                split::calculateFusedOrientation(&ctx[i]);
+            }
+        }
+    }
+    r.seconds = now() - start;
+    r.llcMisses = readCounter(c->llc);
+    r.l1dMisses = readCounter(c->l1d);
+
+    long lines = 0;
+    for (int i = 0; i < streams; i++) {
+        lines += hotLines(ctx[i]);
+    }
+    r.hotLines = (double) lines / streams;
+    return r;
+}
+
+static struct result runLegacy(const struct counters* c, struct legacy::engine* engines,
+                               struct legacy::globals* globals, int streams, int steps) {
+    memset(engines, 0, streams * sizeof(*engines));
+    memset(globals, 0, streams * sizeof(*globals));
+    for (int i = 0; i < streams; i++) {
+        globals[i].initState = true;
+#ifdef NATIVEGYRO_FIXED_POINT
+        fixedFusion_init(&engines[i].fixed);
+#else
+        engines[i].gyroMatrix[0] = 1.0f;
+        engines[i].gyroMatrix[4] = 1.0f;
+        engines[i].gyroMatrix[8] = 1.0f;
+#endif
+        initInputs(engines[i].accel, engines[i].magnet);
+    }
+
+    struct result r;
+    startCounters(c);
+    const double start = now();
+    for (int s = 0; s < steps; s++) {
+        int64_t timestamp;
+        float rate[3];
+        sampleRate(s, &timestamp, rate);
+        for (int i = 0; i < streams; i++) {
+            struct legacy::fusion_context ctx(&engines[i], &globals[i]);
+            if ((s & 3) == 0) {
+                legacy::calculateAccMagOrientation(&ctx);
+            }
+            if (legacy::gyroFunction(&ctx, timestamp, rate)) {
+                legacy::calculateFusedOrientation(&ctx);
+            }
+        }
+    }
+    r.seconds = now() - start;
+    r.llcMisses = readCounter(c->llc);
+    r.l1dMisses = readCounter(c->l1d);
+
+    long lines = 0;
+    for (int i = 0; i < streams; i++) {
+        const struct legacy::fusion_context ctx(&engines[i], &globals[i]);
+        lines += hotLines(ctx);
+    }
+    r.hotLines = (double) lines / streams;
+    return r;
+}
+
+static void keepBest(struct result* best, const struct result* r) {
+    if (r->seconds < best->seconds) {
+        *best = *r;
+    }
+}
+
+static void printResult(const char* name, const struct result* r, double n) {
+    char llc[32], l1d[32];
+    if (r->llcMisses >= 0) {
+        snprintf(llc, sizeof(llc), "%.3f", r->llcMisses / n);
+    } else {
+        snprintf(llc, sizeof(llc), "n/a");
+    }
+    if (r->l1dMisses >= 0) {
+        snprintf(l1d, sizeof(l1d), "%.3f", r->l1dMisses / n);
+    } else {
+        snprintf(l1d, sizeof(l1d), "n/a");
+    }
+    printf("  %-6s %7.1f ns/sample  %4.2f lines/sample  cache misses/sample %6s  "
+           "L1D read misses/sample %6s\n",
+           name, r->seconds * 1e9 / n, r->hotLines, llc, l1d);
+}
@@ -0,0 +1,117 @@
+//
+// Host tool: decodes a sensor trace (trace-*.ngt) to CSV.
+//
+//   tracedump trace.ngt > trace.csv
+//
+// Output columns: timestamp (ns), sensor, x, y, z. Samples of all sensors
+// are merged in timestamp order.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracecodec.h"
+
+static const char* sensorNames[TRACE_SENSOR_COUNT] = { "accel", "gyro", "mag" };
+
+/*Func. Prototypes*/
+
+static uint8_t* readFile(const char* path, size_t* size);
+static int compareSamples(const void* a, const void* b);
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace.ngt>\n", argv[0]);
+        return 2;
+    }
+
+    size_t size;
+    uint8_t* data = readFile(argv[1], &size);
+    if (data == NULL) {
+        fprintf(stderr, "%s: unable to read %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    struct trace_decoder dec;
+    if (!traceDecoder_open(&dec, data, size)) {
+        fprintf(stderr, "%s: %s is not a sensor trace\n", argv[0], argv[1]);
+        free(data);
+        return 1;
+    }
+
+    size_t total = 0;
+    for (uint32_t b = 0; b < dec.blockCount; b++) {
+        total += dec.index[b].count;
+    }
+    struct trace_sample* samples =
+            (struct trace_sample*) malloc((total ? total : 1) * sizeof(struct trace_sample));
+    if (samples == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        traceDecoder_close(&dec);
+        free(data);
+        return 1;
+    }
+
+    size_t count = 0;
+    uint32_t corrupt = 0;
+    struct trace_sample block[TRACE_BLOCK_SAMPLES];
+    for (uint32_t b = 0; b < dec.blockCount; b++) {
+        const int n = traceDecoder_decodeBlock(&dec, b, block);
+        // a block header that disagrees with the index counts as corrupt
+        if (n < 0 || (size_t) n > total - count) {
+            corrupt++;
+            continue;
+        }
+        memcpy(samples + count, block, n * sizeof(struct trace_sample));
+        count += n;
+    }
+
+    // blocks of different sensors overlap in time
+    qsort(samples, count, sizeof(struct trace_sample), compareSamples);
+
+    printf("timestamp,sensor,x,y,z\n");
+    for (size_t i = 0; i < count; i++) {
+        const struct trace_sample* s = &samples[i];
+        printf("%lld,%s,%.6g,%.6g,%.6g\n", (long long) s->timestamp,
+               s->sensor >= 0 && s->sensor < TRACE_SENSOR_COUNT ? sensorNames[s->sensor] : "?",
+               s->v[0], s->v[1], s->v[2]);
+    }
+
+    fprintf(stderr, "%u blocks, %zu samples, %u corrupt blocks skipped\n",
+            dec.blockCount, count, corrupt);
+
+    free(samples);
+    traceDecoder_close(&dec);
+    free(data);
+    return corrupt ? 1 : 0;
+}
+
+static uint8_t* readFile(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    uint8_t* data = NULL;
+    long length;
+    if (fseek(fp, 0, SEEK_END) == 0 && (length = ftell(fp)) >= 0 &&
+        fseek(fp, 0, SEEK_SET) == 0) {
+        data = (uint8_t*) malloc(length ? (size_t) length : 1);
+        if (data != NULL && fread(data, 1, (size_t) length, fp) != (size_t) length) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t) length;
+    }
+    fclose(fp);
+    return data;
+}
+
+static int compareSamples(const void* a, const void* b) {
+    const struct trace_sample* sa = (const struct trace_sample*) a;
+    const struct trace_sample* sb = (const struct trace_sample*) b;
+    if (sa->timestamp != sb->timestamp) {
+        return sa->timestamp < sb->timestamp ? -1 : 1;
+    }
+    return sa->sensor - sb->sensor;
+}